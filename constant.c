@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // F_SETPIPE_SZ
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -8,11 +9,26 @@
 #include <time.h>
 #include <signal.h>
 #include <stddef.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
 
+// Capture backend - build with "make DRM=1" on KMS systems (no dispmanx there)
+#ifndef CAPTURE_BACKEND_DRM
+#define CAPTURE_BACKEND_DRM 0
+#endif
+
+#if CAPTURE_BACKEND_DRM
+#include "drm_capture.h"
+#else
 // Dispmanx headers with proper paths
 #include <bcm_host.h>
 #include <interface/vmcs_host/vc_dispmanx.h>
 #include <interface/vctypes/vc_image_types.h>
+#include "dispmanx_map.h"
+#endif
 
 // Display dimensions
 #define WIDTH 320
@@ -39,11 +55,89 @@
 // SPI settings
 #define SPI_SPEED 32000000  // 32 MHz
 
+// Multi-core settings - number of threads is detected at runtime
+#define MAX_WORKERS 4  // Max threads converting bands (1 = always use the serial path)
+
+// Latest frame wins - SET TO 1 TO ENABLE, 0 TO DISABLE
+// The screen is captured in its own thread while the previous frame is sent,
+// frames captured while SPI is busy are replaced by newer ones and never sent
+#define LATEST_FRAME_WINS 1
+
+// Zero-copy capture - SET TO 1 TO ENABLE, 0 TO DISABLE
+// Snapshots are converted straight from the GPU memory of the resource
+// (needs root for /dev/mem), falls back to copying them out
+#define ZERO_COPY_ENABLED 1
+
+// Motion governor - SET TO 1 TO ENABLE, 0 TO DISABLE
+// During sustained full screen motion the panel is switched to 12-bit color
+// (RGB444, 25% fewer bytes per frame) and back to 16-bit once it settles
+#define GOVERNOR_ENABLED 1
+#define GOVERNOR_ENTER_PERCENT 30   // Changed pixels (% of the frame) counted as a busy frame
+#define GOVERNOR_ENTER_FRAMES 10    // Consecutive busy frames before switching to 12-bit
+#define GOVERNOR_LEAVE_PERCENT 5    // Changed pixels (% of the frame) counted as a calm frame
+#define GOVERNOR_SETTLE_FRAMES 30   // Consecutive calm frames before going back to 16-bit
+
+// Streaming mode - run as "./constant -" (stdin) or "./constant /path/to/fifo" to display
+// raw 320x170 RGB565 big endian frames instead of the framebuffer, for example:
+// ffmpeg -re -i video.mp4 -vf scale=320:170 -pix_fmt rgb565be -f rawvideo - | sudo ./constant -
+#define STREAM_PIPE_FRAMES 4  // Pipe buffer size in frames, stale frames are dropped when SPI falls behind
+
+// KMS/DRM capture settings (only used when built with DRM=1)
+#define DRM_DEVICE "/dev/dri/card0"  // With the vkms virtual driver this is usually card1
+
 // Global variables
 volatile sig_atomic_t keep_running = 1;
+#if !CAPTURE_BACKEND_DRM
 DISPMANX_DISPLAY_HANDLE_T display_handle = 0;
 DISPMANX_RESOURCE_HANDLE_T resource_handle = 0;
 VC_RECT_T rect;
+#endif
+struct timespec startup_time;
+const uint16_t *mapped_frame = NULL;  // Snapshot resource mapped into this process
+
+#if LATEST_FRAME_WINS
+// Capture thread state - everything below is protected by capture_lock
+pthread_t capture_thread;
+pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t capture_cond = PTHREAD_COND_INITIALIZER;
+uint16_t *capture_buffer = NULL;      // Copy of the newest snapshot
+const uint16_t *capture_src = NULL;   // Newest raw frame (capture_buffer or the mapped snapshot)
+int captures_pending = 0;             // Captures since the last send
+int capture_running = 0;
+volatile int capture_exit = 0;
+long superseded_frames = 0;           // Captures replaced by a newer one before being sent
+#endif
+#if GOVERNOR_ENABLED
+int color_degraded = 0;               // Panel is in 12-bit mode
+int busy_frames = 0, calm_frames = 0;
+uint8_t rgb444_buffer[DISPLAY_SIZE * 3 / 2];  // A frame packed two pixels in three bytes
+#endif
+const char *stream_path = NULL;
+
+// Band worker - each one converts its own rows, so no locking is needed
+typedef struct {
+    pthread_t thread;
+    sem_t start;
+    int y_start, y_end;
+    int changed_pixels;
+} band_worker_t;
+
+band_worker_t band_workers[MAX_WORKERS];
+int num_bands = 1;
+sem_t band_done;
+volatile int workers_exit = 0;
+const uint16_t *band_job_src = NULL;
+uint16_t *band_job_dst = NULL;
+
+// Display init sequence: command, argument count (| INIT_DELAY when a delay
+// in ms follows the arguments), arguments. Delays are the ST7789 datasheet minimums.
+#define INIT_DELAY 0x80
+static const uint8_t init_sequence[] = {
+    0x11, INIT_DELAY | 0, 5,     // Sleep Out, 5 ms before the next command
+    0x3A, 1, 0x55,               // Color Mode: 16-bit (RGB565)
+    0x36, 1, 0x60,               // MADCTL: MV=1, MX=1, MY=0 (270° rotation)
+    0x21, 0,                     // Display Inversion On
+};
 
 // Function prototypes
 void init_gpio(void);
@@ -54,10 +148,24 @@ void write_data_len(const uint8_t *data, uint32_t len);
 void set_window(uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end);
 int init_dispmanx(void);
 void display_framebuffer_dispmanx(void);
+int read_stream_frame(int fd, uint8_t *frame);
+void display_stream(void);
 void cleanup(void);
 void signal_handler(int sig);
+void report_time_to_first_frame(void);
 uint16_t fix_color_format(uint16_t color);
-void apply_interlacing(uint16_t *buffer);
+void apply_interlacing(uint16_t *buffer, int y_start, int y_end);
+int convert_band(const uint16_t *src, uint16_t *dst, int y_start, int y_end);
+int convert_frame(const uint16_t *src, uint16_t *dst);
+int capture_screen(uint16_t *buffer, const uint16_t **src);
+void *capture_thread_main(void *arg);
+int take_latest_frame(uint16_t *dst, int *changed_pixels);
+void set_color_mode(int degraded);
+void governor_update(int changed_pixels);
+uint32_t pack_rgb444(const uint16_t *pixels, uint32_t count, uint8_t *out);
+void split_bands(int bands);
+void init_workers(void);
+void stop_workers(void);
 
 // Signal handler for clean exit
 void signal_handler(int sig) {
@@ -69,10 +177,10 @@ uint16_t fix_color_format(uint16_t color) {
     return ((color & 0xFF) << 8) | (color >> 8);
 }
 
-// Apply interlacing to buffer - every other line becomes black
-void apply_interlacing(uint16_t *buffer) {
+// Apply interlacing to rows of a buffer - every other line becomes black
+void apply_interlacing(uint16_t *buffer, int y_start, int y_end) {
     #if INTERLACE_ENABLED
-    for (int y = 0; y < HEIGHT; y++) {
+    for (int y = y_start; y < y_end; y++) {
         if (y % INTERLACE_EVERY == 1) {  // Make every other line black
             for (int x = 0; x < WIDTH; x++) {
                 buffer[y * WIDTH + x] = 0x0000;  // Black
@@ -142,75 +250,73 @@ void set_window(uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_e
     y_end += ROW_OFFSET;
     
     // Column address set
+    uint8_t caset[4] = { x_start >> 8, x_start & 0xFF, x_end >> 8, x_end & 0xFF };
     write_command(0x2A);
-    write_data(x_start >> 8);
-    write_data(x_start & 0xFF);
-    write_data(x_end >> 8);
-    write_data(x_end & 0xFF);
+    write_data_len(caset, sizeof(caset));
     
     // Row address set
+    uint8_t raset[4] = { y_start >> 8, y_start & 0xFF, y_end >> 8, y_end & 0xFF };
     write_command(0x2B);
-    write_data(y_start >> 8);
-    write_data(y_start & 0xFF);
-    write_data(y_end >> 8);
-    write_data(y_end & 0xFF);
+    write_data_len(raset, sizeof(raset));
     
     // Memory write
     write_command(0x2C);
 }
 
-// Initialize display with optimized command sequence and offset support
+// Initialize display with a table-driven command sequence and offset support
 void init_display(void) {
-    // Reset display
+    // Hardware reset: RESX low pulse needs >= 10 us, then 120 ms before Sleep Out
+    // (worst case, when the panel was left in Sleep Out by a previous run).
+    // A hardware reset makes SWRESET redundant, so it is not sent.
     bcm2835_gpio_write(RST_PIN, LOW);
-    bcm2835_delay(100);
+    bcm2835_delayMicroseconds(20);
     bcm2835_gpio_write(RST_PIN, HIGH);
-    bcm2835_delay(100);
-    
-    // Send initialization commands
-    write_command(0x01);  // SWRESET
     bcm2835_delay(120);
     
-    write_command(0x11);  // Sleep Out
-    bcm2835_delay(120);
-    
-    write_command(0x3A); // Color Mode
-    write_data(0x55);    // 16-bit color (RGB565)
-    
-    // MADCTL - Memory Data Access Control
-    write_command(0x36);
-    write_data(0x60); // MV=1, MX=1, MY=0 (270° rotation)
-    
-    write_command(0x21);  // Display Inversion On
-    
-    // Set column address with offset support
-    write_command(0x2A);
-    write_data(COL_OFFSET >> 8);
-    write_data(COL_OFFSET & 0xFF);
-    write_data((COL_OFFSET + WIDTH - 1) >> 8);
-    write_data((COL_OFFSET + WIDTH - 1) & 0xFF);
-    
-    // Set row address with offset support
-    write_command(0x2B);
-    write_data(ROW_OFFSET >> 8);
-    write_data(ROW_OFFSET & 0xFF);
-    write_data((ROW_OFFSET + HEIGHT - 1) >> 8);
-    write_data((ROW_OFFSET + HEIGHT - 1) & 0xFF);
-    
-    write_command(0x29);  // Display ON
-    bcm2835_delay(100);
+    // Send initialization commands
+    const uint8_t *p = init_sequence;
+    const uint8_t *end = init_sequence + sizeof(init_sequence);
+    while (p < end) {
+        uint8_t cmd = *p++;
+        uint8_t flags = *p++;
+        uint8_t nargs = flags & ~INIT_DELAY;
+        
+        write_command(cmd);
+        if (nargs > 0) {
+            write_data_len(p, nargs);
+            p += nargs;
+        }
+        if (flags & INIT_DELAY) {
+            bcm2835_delay(*p++);
+        }
+    }
     
-    // Clear display to check alignment
+    // Clear display RAM before turning the panel on so no garbage is shown,
+    // using a single bulk transfer from a zeroed buffer
     set_window(0, 0, WIDTH-1, HEIGHT-1);
-    uint16_t black = 0x0000;
-    for (int i = 0; i < WIDTH * HEIGHT; i++) {
-        write_data(black >> 8);
-        write_data(black & 0xFF);
+    uint8_t *black = calloc(1, DISPLAY_BYTES);
+    if (black) {
+        write_data_len(black, DISPLAY_BYTES);
+        free(black);
+    } else {
+        // Fallback: clear row by row from a zeroed line
+        static const uint8_t black_line[WIDTH * 2];
+        for (int y = 0; y < HEIGHT; y++) {
+            write_data_len(black_line, sizeof(black_line));
+        }
     }
+    
+    write_command(0x29);  // Display ON (no delay required before RAM writes)
 }
 
 // Initialize Dispmanx with 16-bit format only
 int init_dispmanx(void) {
+    #if CAPTURE_BACKEND_DRM
+    if (!drm_capture_init(DRM_DEVICE, WIDTH, HEIGHT)) {
+        return 0;
+    }
+    printf("Display offset: COL=%d, ROW=%d\n", COL_OFFSET, ROW_OFFSET);
+    #else
     bcm_host_init();
     
     // Get display size
@@ -229,12 +335,6 @@ int init_dispmanx(void) {
     printf("Display size: %dx%d\n", display_info.width, display_info.height);
     printf("Display offset: COL=%d, ROW=%d\n", COL_OFFSET, ROW_OFFSET);
     
-    #if INTERLACE_ENABLED
-    printf("Interlacing: ENABLED (every %d lines)\n", INTERLACE_EVERY);
-    #else
-    printf("Interlacing: DISABLED\n");
-    #endif
-    
     // Create resource with 16-bit format only
     uint32_t vc_image_ptr;
     resource_handle = vc_dispmanx_resource_create(
@@ -254,6 +354,18 @@ int init_dispmanx(void) {
     // Set up rectangle
     vc_dispmanx_rect_set(&rect, 0, 0, WIDTH, HEIGHT);
     
+    #if ZERO_COPY_ENABLED
+    mapped_frame = dispmanx_map_resource(display_handle, resource_handle, WIDTH, HEIGHT);
+    printf("Zero-copy capture: %s\n", mapped_frame ? "ENABLED" : "DISABLED (copying snapshots)");
+    #endif
+    #endif
+    
+    #if INTERLACE_ENABLED
+    printf("Interlacing: ENABLED (every %d lines)\n", INTERLACE_EVERY);
+    #else
+    printf("Interlacing: DISABLED\n");
+    #endif
+    
     return 1;
 }
 
@@ -266,7 +378,7 @@ void display_framebuffer_dispmanx(void) {
     
     // Create buffers for display data
     uint16_t *dispmanx_buffer = malloc(DISPLAY_SIZE * sizeof(uint16_t));
-    uint16_t *display_buffer = malloc(DISPLAY_SIZE * sizeof(uint16_t));
+    uint16_t *display_buffer = calloc(DISPLAY_SIZE, sizeof(uint16_t));  // Zeroed, diffed against while converting
     
     if (!dispmanx_buffer || !display_buffer) {
         printf("Error allocating display buffers\n");
@@ -281,29 +393,51 @@ void display_framebuffer_dispmanx(void) {
     clock_gettime(CLOCK_MONOTONIC, &start_time);
     #endif
     
+    #if LATEST_FRAME_WINS
+    // Start capturing in the background, into dispmanx_buffer
+    capture_buffer = dispmanx_buffer;
+    capture_running = pthread_create(&capture_thread, NULL, capture_thread_main, NULL) == 0;
+    if (!capture_running) {
+        printf("Failed to start capture thread\n");
+        free(dispmanx_buffer);
+        free(display_buffer);
+        return;
+    }
+    #endif
+    
     while (keep_running) {
-        // Take snapshot of the display (GPU accelerated)
-        if (vc_dispmanx_snapshot(display_handle, resource_handle, 0) != 0) {
-            printf("Dispmanx snapshot failed\n");
-            break;
-        }
+        // Pixels that differ from the previous frame, counted while converting
+        int changed_pixels;
         
-        // Read data from GPU resource
-        if (vc_dispmanx_resource_read_data(resource_handle, &rect, dispmanx_buffer, WIDTH * 2) != 0) {
-            printf("Failed to read resource data\n");
+        #if LATEST_FRAME_WINS
+        // Convert the newest capture (color correction and interlacing, band-parallel)
+        if (take_latest_frame(display_buffer, &changed_pixels) != 0) {
             break;
         }
-        
-        // Apply color correction
-        for (int i = 0; i < DISPLAY_SIZE; i++) {
-            display_buffer[i] = fix_color_format(dispmanx_buffer[i]);
+        #else
+        const uint16_t *capture_src;
+        if (capture_screen(dispmanx_buffer, &capture_src) != 0) {
+            break;
         }
         
-        // Apply interlacing if enabled
-        apply_interlacing(display_buffer);
+        // Apply color correction and interlacing (band-parallel)
+        changed_pixels = convert_frame(capture_src, display_buffer);
+        #endif
         
         // Send data to SPI display
+        #if GOVERNOR_ENABLED
+        governor_update(changed_pixels);
+        if (color_degraded) {
+            write_data_len(rgb444_buffer, pack_rgb444(display_buffer, DISPLAY_SIZE, rgb444_buffer));
+        } else {
+            write_data_len((uint8_t*)display_buffer, DISPLAY_SIZE * 2);
+        }
+        #else
+        (void)changed_pixels;
         write_data_len((uint8_t*)display_buffer, DISPLAY_SIZE * 2);
+        #endif
+        
+        report_time_to_first_frame();
         
         #if SHOW_FPS
         frame_count++;
@@ -316,26 +450,412 @@ void display_framebuffer_dispmanx(void) {
             
             if (elapsed_time >= 1000000000) {
                 float fps = frame_count * 1000000000.0f / elapsed_time;
-                printf("FPS: %.1f\n", fps);
+                printf("FPS: %.1f", fps);
+                #if GOVERNOR_ENABLED
+                printf(" [%d-bit]", color_degraded ? 12 : 16);
+                #endif
+                #if LATEST_FRAME_WINS
+                pthread_mutex_lock(&capture_lock);
+                printf(" (Superseded: %ld)", superseded_frames);
+                pthread_mutex_unlock(&capture_lock);
+                #endif
+                printf("\n");
                 frame_count = 0;
                 clock_gettime(CLOCK_MONOTONIC, &start_time);
             }
         }
         #endif
         
+        #if !LATEST_FRAME_WINS
         // Small sleep to prevent 100% CPU usage
         usleep(5000);
+        #endif
     }
     
+    #if LATEST_FRAME_WINS
+    capture_exit = 1;
+    pthread_join(capture_thread, NULL);
+    #endif
+    
     free(dispmanx_buffer);
     free(display_buffer);
 }
 
+// Capture the screen into buffer, src is set to the raw frame (buffer, or the
+// mapped snapshot which needs no copy). Returns 0 on success
+int capture_screen(uint16_t *buffer, const uint16_t **src) {
+    *src = buffer;
+    
+    #if CAPTURE_BACKEND_DRM
+    // Scale the KMS scanout buffer down to the display size (damage is not needed here)
+    drm_damage_t damage;
+    if (drm_capture_begin(&damage) != 0) {
+        printf("DRM capture failed\n");
+        return -1;
+    }
+    drm_capture_rows(buffer, 0, HEIGHT);
+    drm_capture_end();
+    #else
+    // Take snapshot of the display (GPU accelerated)
+    if (vc_dispmanx_snapshot(display_handle, resource_handle, 0) != 0) {
+        printf("Dispmanx snapshot failed\n");
+        return -1;
+    }
+    
+    // Read data from GPU resource, unless it is mapped and can be converted in place
+    if (mapped_frame) {
+        *src = mapped_frame;
+    } else if (vc_dispmanx_resource_read_data(resource_handle, &rect, buffer, WIDTH * 2) != 0) {
+        printf("Failed to read resource data\n");
+        return -1;
+    }
+    #endif
+    
+    return 0;
+}
+
+#if LATEST_FRAME_WINS
+// Capture thread - keeps capturing while the previous frame is sent, a capture
+// nobody took yet is simply replaced by the next one
+void *capture_thread_main(void *arg) {
+    while (!capture_exit && keep_running) {
+        pthread_mutex_lock(&capture_lock);
+        int result = capture_screen(capture_buffer, &capture_src);
+        if (result == 0) {
+            if (captures_pending++ > 0) {
+                superseded_frames++;
+            }
+            pthread_cond_signal(&capture_cond);
+        }
+        pthread_mutex_unlock(&capture_lock);
+        
+        if (result != 0) {
+            break;
+        }
+        
+        // Small sleep to prevent 100% CPU usage
+        usleep(5000);
+    }
+    
+    pthread_mutex_lock(&capture_lock);
+    capture_running = 0;
+    pthread_cond_signal(&capture_cond);
+    pthread_mutex_unlock(&capture_lock);
+    return NULL;
+}
+
+// Wait for a capture and convert the newest one into dst, counting the pixels
+// that changed. Returns 0 on success, -1 once the capture thread stopped
+int take_latest_frame(uint16_t *dst, int *changed_pixels) {
+    pthread_mutex_lock(&capture_lock);
+    while (captures_pending == 0 && capture_running) {
+        pthread_cond_wait(&capture_cond, &capture_lock);
+    }
+    
+    if (captures_pending == 0) {
+        pthread_mutex_unlock(&capture_lock);
+        return -1;
+    }
+    
+    // Converted under the lock, the next capture overwrites the raw frame
+    *changed_pixels = convert_frame(capture_src, dst);
+    captures_pending = 0;
+    
+    pthread_mutex_unlock(&capture_lock);
+    return 0;
+}
+#endif
+
+// Report time from startup to the first frame sent (once)
+void report_time_to_first_frame(void) {
+    static int reported = 0;
+    if (reported) return;
+    reported = 1;
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed_ns = (now.tv_sec - startup_time.tv_sec) * 1000000000 +
+                      (now.tv_nsec - startup_time.tv_nsec);
+    printf("Time to first frame: %.1f ms\n", elapsed_ns / 1000000.0f);
+}
+
+// Convert rows [y_start, y_end) to the display format over the previous frame
+// in dst, returns how many pixels changed
+int convert_band(const uint16_t *src, uint16_t *dst, int y_start, int y_end) {
+    int changed_pixels = 0;
+    
+    // Apply color correction
+    for (int y = y_start; y < y_end; y++) {
+        #if INTERLACE_ENABLED
+        if (y % INTERLACE_EVERY == 1) continue;  // Blacked out below
+        #endif
+        for (int i = y * WIDTH; i < (y + 1) * WIDTH; i++) {
+            uint16_t pixel = fix_color_format(src[i]);
+            changed_pixels += pixel != dst[i];
+            dst[i] = pixel;
+        }
+    }
+    
+    // Apply interlacing if enabled
+    apply_interlacing(dst, y_start, y_end);
+    
+    return changed_pixels;
+}
+
+// Band worker thread - waits for a frame, converts its band, repeats
+void *band_worker_main(void *arg) {
+    band_worker_t *worker = arg;
+    
+    while (1) {
+        sem_wait(&worker->start);
+        if (workers_exit) break;
+        
+        worker->changed_pixels = convert_band(band_job_src, band_job_dst, worker->y_start, worker->y_end);
+        
+        sem_post(&band_done);
+    }
+    
+    return NULL;
+}
+
+// Split the frame into horizontal bands, one per thread
+void split_bands(int bands) {
+    int rows_per_band = HEIGHT / bands;
+    for (int i = 0; i < bands; i++) {
+        band_workers[i].y_start = i * rows_per_band;
+        band_workers[i].y_end = (i == bands - 1) ? HEIGHT : (i + 1) * rows_per_band;
+    }
+    num_bands = bands;
+}
+
+// Start one worker thread per extra core
+void init_workers(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int bands = cores < 1 ? 1 : (cores > MAX_WORKERS ? MAX_WORKERS : cores);
+    
+    // Single core (Pi 1): keep the serial path, no threads
+    split_bands(1);
+    if (bands == 1) {
+        printf("Workers: serial (cores: %ld)\n", cores);
+        return;
+    }
+    
+    sem_init(&band_done, 0, 0);
+    
+    // Band 0 is processed by the calling thread
+    int started = 1;
+    for (int i = 1; i < bands; i++) {
+        sem_init(&band_workers[i].start, 0, 0);
+        if (pthread_create(&band_workers[i].thread, NULL, band_worker_main, &band_workers[i]) != 0) {
+            printf("Failed to start worker thread %d\n", i);
+            sem_destroy(&band_workers[i].start);
+            break;
+        }
+        started++;
+    }
+    
+    split_bands(started);
+    printf("Workers: %d (cores: %ld)\n", num_bands, cores);
+}
+
+// Stop and join the worker threads
+void stop_workers(void) {
+    workers_exit = 1;
+    for (int i = 1; i < num_bands; i++) {
+        sem_post(&band_workers[i].start);
+        pthread_join(band_workers[i].thread, NULL);
+        sem_destroy(&band_workers[i].start);
+    }
+    if (num_bands > 1) {
+        sem_destroy(&band_done);
+    }
+    split_bands(1);
+}
+
+// Convert a whole frame, band-parallel when workers are running. Returns the
+// number of pixels that changed
+int convert_frame(const uint16_t *src, uint16_t *dst) {
+    if (num_bands == 1) {
+        return convert_band(src, dst, 0, HEIGHT);
+    }
+    
+    band_job_src = src;
+    band_job_dst = dst;
+    for (int i = 1; i < num_bands; i++) {
+        sem_post(&band_workers[i].start);
+    }
+    int changed_pixels = convert_band(src, dst, band_workers[0].y_start, band_workers[0].y_end);
+    for (int i = 1; i < num_bands; i++) {
+        sem_wait(&band_done);
+    }
+    for (int i = 1; i < num_bands; i++) {
+        changed_pixels += band_workers[i].changed_pixels;
+    }
+    return changed_pixels;
+}
+
+#if GOVERNOR_ENABLED
+// Switch the panel between 16-bit (RGB565) and 12-bit (RGB444) pixels, and
+// restart the full screen window for the next frame
+void set_color_mode(int degraded) {
+    write_command(0x3A);
+    write_data(degraded ? 0x53 : 0x55);
+    set_window(0, 0, WIDTH-1, HEIGHT-1);
+    color_degraded = degraded;
+}
+
+// Count busy and calm frames, switching the color mode after enough of them in a row
+void governor_update(int changed_pixels) {
+    int percent = changed_pixels * 100 / DISPLAY_SIZE;
+    
+    if (!color_degraded) {
+        busy_frames = percent >= GOVERNOR_ENTER_PERCENT ? busy_frames + 1 : 0;
+        if (busy_frames >= GOVERNOR_ENTER_FRAMES) {
+            printf("Governor: sustained motion, switching to 12-bit color\n");
+            set_color_mode(1);
+            busy_frames = 0;
+            calm_frames = 0;
+        }
+    } else {
+        calm_frames = percent <= GOVERNOR_LEAVE_PERCENT ? calm_frames + 1 : 0;
+        if (calm_frames >= GOVERNOR_SETTLE_FRAMES) {
+            printf("Governor: motion settled, back to 16-bit color\n");
+            set_color_mode(0);
+        }
+    }
+}
+
+// Pack display format (byte swapped RGB565) pixels into RGB444, two pixels in
+// three bytes. Returns the number of bytes written
+uint32_t pack_rgb444(const uint16_t *pixels, uint32_t count, uint8_t *out) {
+    uint8_t *p = out;
+    
+    for (uint32_t i = 0; i < count; i += 2) {
+        uint16_t a = fix_color_format(pixels[i]);
+        uint16_t b = i + 1 < count ? fix_color_format(pixels[i + 1]) : 0;
+        *p++ = ((a >> 12) << 4) | ((a >> 7) & 0x0F);   // R1 G1
+        *p++ = (((a >> 1) & 0x0F) << 4) | (b >> 12);   // B1 R2
+        if (i + 1 < count) {
+            *p++ = (((b >> 7) & 0x0F) << 4) | ((b >> 1) & 0x0F);  // G2 B2
+        }
+    }
+    
+    return p - out;
+}
+#endif
+
+// Read one whole frame from the stream, returns 0 at end of stream
+int read_stream_frame(int fd, uint8_t *frame) {
+    size_t got = 0;
+    
+    while (got < DISPLAY_BYTES) {
+        ssize_t len = read(fd, frame + got, DISPLAY_BYTES - got);
+        if (len < 0 && errno == EINTR) {
+            if (!keep_running) return 0;
+            continue;
+        }
+        if (len <= 0) return 0;
+        got += len;
+    }
+    
+    return 1;
+}
+
+// Display raw RGB565 big endian frames from stdin or a FIFO, straight to SPI
+void display_stream(void) {
+    int fd = strcmp(stream_path, "-") == 0 ? STDIN_FILENO : open(stream_path, O_RDONLY);
+    if (fd < 0) {
+        printf("Failed to open stream %s\n", stream_path);
+        return;
+    }
+    
+    // Only pipes and sockets queue frames that can go stale, on a regular file
+    // FIONREAD is the rest of the file and every frame is shown
+    struct stat st;
+    int live_input = fstat(fd, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode));
+    
+    // Room for a few frames in the pipe so stale ones can be detected and skipped
+    if (live_input) {
+        fcntl(fd, F_SETPIPE_SZ, STREAM_PIPE_FRAMES * DISPLAY_BYTES);
+    }
+    
+    // Frames are read straight into the buffer handed to SPI, no intermediate copies
+    uint8_t *frame = NULL;
+    if (posix_memalign((void **)&frame, 4096, DISPLAY_BYTES) != 0) {
+        printf("Error allocating stream buffer\n");
+        if (fd != STDIN_FILENO) close(fd);
+        return;
+    }
+    
+    printf("Streaming raw frames from %s...\n", fd == STDIN_FILENO ? "stdin" : stream_path);
+    set_window(0, 0, WIDTH-1, HEIGHT-1);
+    
+    long dropped_frames = 0;
+    #if SHOW_FPS
+    struct timespec start_time, current_time;
+    long frame_count = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    #endif
+    
+    while (keep_running) {
+        // Skip ahead while a newer complete frame is already waiting, so the
+        // panel follows the input frame rate when SPI falls behind
+        int buffered = 0;
+        while (live_input && ioctl(fd, FIONREAD, &buffered) == 0 && buffered >= 2 * DISPLAY_BYTES) {
+            if (!read_stream_frame(fd, frame)) break;
+            dropped_frames++;
+        }
+        
+        if (!read_stream_frame(fd, frame)) {
+            printf("End of stream\n");
+            break;
+        }
+        
+        // Apply interlacing if enabled (in place)
+        apply_interlacing((uint16_t*)frame, 0, HEIGHT);
+        
+        // Restart the memory write at the window origin and send the frame
+        write_command(0x2C);
+        write_data_len(frame, DISPLAY_BYTES);
+        
+        report_time_to_first_frame();
+        
+        #if SHOW_FPS
+        frame_count++;
+        
+        // FPS reporting
+        if (frame_count % 60 == 0) {
+            clock_gettime(CLOCK_MONOTONIC, &current_time);
+            long elapsed_time = (current_time.tv_sec - start_time.tv_sec) * 1000000000 + 
+                               (current_time.tv_nsec - start_time.tv_nsec);
+            
+            if (elapsed_time >= 1000000000) {
+                float fps = frame_count * 1000000000.0f / elapsed_time;
+                printf("FPS: %.1f (Dropped: %ld)\n", fps, dropped_frames);
+                frame_count = 0;
+                clock_gettime(CLOCK_MONOTONIC, &start_time);
+            }
+        }
+        #endif
+    }
+    
+    printf("Dropped frames: %ld\n", dropped_frames);
+    free(frame);
+    if (fd != STDIN_FILENO) close(fd);
+}
+
 // Cleanup resources
 void cleanup(void) {
     printf("Cleaning up resources...\n");
     
+    stop_workers();
+    
+    #if CAPTURE_BACKEND_DRM
+    drm_capture_cleanup();
+    #else
     // Clean up Dispmanx resources
+    dispmanx_unmap_resource();
+    
     if (resource_handle != 0) {
         vc_dispmanx_resource_delete(resource_handle);
     }
@@ -344,7 +864,11 @@ void cleanup(void) {
         vc_dispmanx_display_close(display_handle);
     }
     
-    bcm_host_deinit();
+    // bcm_host is not initialized in streaming mode
+    if (!stream_path) {
+        bcm_host_deinit();
+    }
+    #endif
     
     bcm2835_spi_end();
     bcm2835_close();
@@ -352,6 +876,8 @@ void cleanup(void) {
 
 // Main function
 int main(int argc, char *argv[]) {
+    clock_gettime(CLOCK_MONOTONIC, &startup_time);
+    
     printf("Initializing ST7789 display with 16-bit color handling...\n");
     printf("Display dimensions: %dx%d\n", WIDTH, HEIGHT);
     #if SHOW_FPS
@@ -370,6 +896,15 @@ int main(int argc, char *argv[]) {
     init_display();
     printf("Display initialized\n");
     
+    // Streaming mode: frames come from stdin/FIFO, no capture needed
+    if (argc > 1) {
+        stream_path = argv[1];
+        display_stream();
+        cleanup();
+        printf("Exited cleanly\n");
+        return 0;
+    }
+    
     printf("Initializing Dispmanx...\n");
     if (!init_dispmanx()) {
         printf("Failed to initialize Dispmanx\n");
@@ -378,6 +913,8 @@ int main(int argc, char *argv[]) {
     }
     printf("Dispmanx initialized\n");
     
+    init_workers();
+    
     printf("Starting framebuffer display...\n");
     printf("Press Ctrl+C to exit\n");
     
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "dispmanx_map.h"
+
+// VideoCore mailbox property interface
+#define MBOX_DEVICE "/dev/vcio"
+#define IOCTL_MBOX_PROPERTY _IOWR(100, 0, char *)
+#define MBOX_TAG_MEM_LOCK 0x3000D    // GPU memory handle -> bus address, pins the memory
+#define MBOX_TAG_MEM_UNLOCK 0x3000E
+#define MBOX_RESPONSE_OK 0x80000000
+
+// Bus addresses carry the GPU cache alias in the top two bits
+#define BUS_TO_PHYS(addr) ((addr) & ~0xC0000000)
+
+#define MAP_CHECK_SNAPSHOTS 3  // Snapshots compared through the mapping and copied out
+#define MAP_TIMING_FRAMES 10   // Frames read each way to pick the faster one
+
+static int mbox_fd = -1;
+static uint32_t mem_handle = 0;
+static void *map_base = MAP_FAILED;
+static size_t map_size = 0;
+
+// Send a one-word mailbox property request, returns the response word or 0
+static uint32_t mbox_property(uint32_t tag, uint32_t value) {
+    uint32_t msg[7] __attribute__((aligned(16))) = {
+        sizeof(msg), 0,      // Buffer size, request code
+        tag, 4, 4, value,    // Tag, value buffer size, request size, value
+        0                    // End tag
+    };
+    
+    if (ioctl(mbox_fd, IOCTL_MBOX_PROPERTY, msg) < 0 || msg[1] != MBOX_RESPONSE_OK) {
+        return 0;
+    }
+    return msg[5];
+}
+
+// Read every pixel of a frame once, like the convert and diff loops do
+static uint32_t read_frame(const uint16_t *pixels, size_t count) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += pixels[i];
+    }
+    return sum;
+}
+
+// Nanoseconds elapsed since start
+static long elapsed_ns(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000000 + (now.tv_nsec - start->tv_nsec);
+}
+
+// Lock the resource's memory through the mailbox and map it from /dev/mem.
+// GPU memory is not kernel RAM, so /dev/mem can only map it uncached and there
+// is nothing to invalidate after a snapshot. Uncached loads are slow, so the
+// mapping is timed against copying the snapshot out and only used when it wins.
+// A written pattern and a few snapshots are checked first so a wrong mapping is
+// never used
+const uint16_t *dispmanx_map_resource(DISPMANX_DISPLAY_HANDLE_T display, DISPMANX_RESOURCE_HANDLE_T resource,
+                                      int width, int height) {
+    size_t frame_bytes = (size_t)width * height * 2;
+    
+    // Resource rows are padded to 32 bytes, the mapping is used as a plain array
+    if ((width * 2) % 32 != 0) {
+        printf("Zero-copy capture: row pitch of %d pixels is padded\n", width);
+        return NULL;
+    }
+    
+    mem_handle = vc_dispmanx_resource_get_image_handle(resource);
+    if (mem_handle == 0) {
+        printf("Zero-copy capture: no image handle for the resource\n");
+        return NULL;
+    }
+    
+    mbox_fd = open(MBOX_DEVICE, O_RDWR);
+    if (mbox_fd < 0) {
+        printf("Zero-copy capture: failed to open %s\n", MBOX_DEVICE);
+        return NULL;
+    }
+    
+    uint32_t bus_addr = mbox_property(MBOX_TAG_MEM_LOCK, mem_handle);
+    if (bus_addr == 0) {
+        printf("Zero-copy capture: failed to lock the resource memory\n");
+        close(mbox_fd);
+        mbox_fd = -1;
+        return NULL;
+    }
+    
+    int mem_fd = open("/dev/mem", O_RDONLY | O_SYNC);
+    if (mem_fd < 0) {
+        printf("Zero-copy capture: failed to open /dev/mem\n");
+        dispmanx_unmap_resource();
+        return NULL;
+    }
+    
+    uint32_t phys_addr = BUS_TO_PHYS(bus_addr);
+    uint32_t page_offset = phys_addr % sysconf(_SC_PAGESIZE);
+    map_size = page_offset + frame_bytes;
+    map_base = mmap(NULL, map_size, PROT_READ, MAP_SHARED, mem_fd, phys_addr - page_offset);
+    close(mem_fd);
+    
+    if (map_base == MAP_FAILED) {
+        printf("Zero-copy capture: failed to map resource memory\n");
+        dispmanx_unmap_resource();
+        return NULL;
+    }
+    
+    const uint16_t *pixels = (const uint16_t *)((uint8_t *)map_base + page_offset);
+    size_t count = (size_t)width * height;
+    uint16_t *copy = malloc(frame_bytes);
+    VC_RECT_T rect;
+    vc_dispmanx_rect_set(&rect, 0, 0, width, height);
+    
+    // A pattern written into the resource must show up in the mapping, a mapping
+    // of the wrong memory could match snapshots of a black screen
+    int ok = copy != NULL;
+    for (size_t i = 0; ok && i < count; i++) {
+        copy[i] = (uint16_t)(i * 40503u) | 1;
+    }
+    ok = ok && vc_dispmanx_resource_write_data(resource, VC_IMAGE_RGB565, width * 2, copy, &rect) == 0 &&
+         memcmp(copy, pixels, frame_bytes) == 0;
+    
+    // Then snapshots through the mapping must match copied ones
+    for (int i = 0; ok && i < MAP_CHECK_SNAPSHOTS; i++) {
+        ok = vc_dispmanx_snapshot(display, resource, 0) == 0 &&
+             vc_dispmanx_resource_read_data(resource, &rect, copy, width * 2) == 0 &&
+             memcmp(copy, pixels, frame_bytes) == 0;
+    }
+    
+    if (!ok) {
+        printf("Zero-copy capture: mapped snapshot doesn't match, not using it\n");
+        free(copy);
+        dispmanx_unmap_resource();
+        return NULL;
+    }
+    
+    // Snapshot and read every pixel through the mapping, then through a copy
+    volatile uint32_t sum = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < MAP_TIMING_FRAMES; i++) {
+        vc_dispmanx_snapshot(display, resource, 0);
+        sum += read_frame(pixels, count);
+    }
+    long mapped_ns = elapsed_ns(&start) / MAP_TIMING_FRAMES;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < MAP_TIMING_FRAMES; i++) {
+        vc_dispmanx_snapshot(display, resource, 0);
+        vc_dispmanx_resource_read_data(resource, &rect, copy, width * 2);
+        sum += read_frame(copy, count);
+    }
+    long copied_ns = elapsed_ns(&start) / MAP_TIMING_FRAMES;
+    free(copy);
+    
+    printf("Zero-copy capture: %.2f ms per frame mapped, %.2f ms copied\n",
+           mapped_ns / 1000000.0f, copied_ns / 1000000.0f);
+    if (mapped_ns >= copied_ns) {
+        dispmanx_unmap_resource();
+        return NULL;
+    }
+    
+    return pixels;
+}
+
+// Unmap the resource and unlock its GPU memory
+void dispmanx_unmap_resource(void) {
+    if (map_base != MAP_FAILED) {
+        munmap(map_base, map_size);
+        map_base = MAP_FAILED;
+    }
+    
+    if (mbox_fd >= 0) {
+        mbox_property(MBOX_TAG_MEM_UNLOCK, mem_handle);
+        close(mbox_fd);
+        mbox_fd = -1;
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef DISPMANX_MAP_H
+#define DISPMANX_MAP_H
+
+#include <stdint.h>
+#include <bcm_host.h>
+
+// Map the pixels of an RGB565 dispmanx resource (width x height, rows not padded)
+// into this process, so snapshots can be used in place instead of copied out with
+// vc_dispmanx_resource_read_data(). Returns NULL when the mapping is not available
+// or reading through it is slower than copying the snapshot out
+const uint16_t *dispmanx_map_resource(DISPMANX_DISPLAY_HANDLE_T display, DISPMANX_RESOURCE_HANDLE_T resource,
+                                      int width, int height);
+
+// Unmap the resource and unlock its GPU memory
+void dispmanx_unmap_resource(void);
+
+#endif
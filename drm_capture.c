@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/dma-buf.h>
+
+// KMS/DRM headers (libdrm)
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <drm_fourcc.h>
+
+#include "drm_capture.h"
+
+// Number of framebuffers kept mapped (page flipping clients alternate between 2-3)
+#define FB_CACHE_SIZE 3
+
+// Mapped scanout framebuffer
+typedef struct {
+    uint32_t fb_id;
+    uint8_t *map;
+    size_t map_size;
+    int prime_fd;        // dma-buf fd, -1 when mapped as a dumb buffer
+    uint32_t width, height;
+    uint32_t pitch, offset;
+    uint32_t format;
+} fb_map_t;
+
+static int drm_fd = -1;
+static int out_width, out_height;
+static uint32_t plane_id = 0;
+static uint32_t damage_prop_id = 0;
+static uint32_t last_fb_id = 0;
+static uint64_t last_damage_blob = 0;
+static fb_map_t fb_cache[FB_CACHE_SIZE];
+static int fb_cache_next = 0;
+static fb_map_t *current_fb = NULL;
+static int *x_lut = NULL;
+static uint32_t x_lut_width = 0;
+
+// Look up a property id of a DRM object by name
+static uint32_t find_property(uint32_t object_id, uint32_t object_type, const char *name, uint64_t *value) {
+    drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(drm_fd, object_id, object_type);
+    uint32_t prop_id = 0;
+    
+    if (!props) return 0;
+    
+    for (uint32_t i = 0; i < props->count_props && prop_id == 0; i++) {
+        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, props->props[i]);
+        if (!prop) continue;
+        if (strcmp(prop->name, name) == 0) {
+            prop_id = prop->prop_id;
+            if (value) *value = props->prop_values[i];
+        }
+        drmModeFreeProperty(prop);
+    }
+    
+    drmModeFreeObjectProperties(props);
+    return prop_id;
+}
+
+// Open the DRM device and find the primary plane to capture
+int drm_capture_init(const char *device, int width, int height) {
+    out_width = width;
+    out_height = height;
+    
+    for (int i = 0; i < FB_CACHE_SIZE; i++) {
+        fb_cache[i].fb_id = 0;
+        fb_cache[i].map = NULL;
+        fb_cache[i].prime_fd = -1;
+    }
+    
+    drm_fd = open(device, O_RDWR | O_CLOEXEC);
+    if (drm_fd < 0) {
+        printf("Failed to open %s\n", device);
+        return 0;
+    }
+    
+    // Universal planes to see the primary plane, atomic to see FB_DAMAGE_CLIPS
+    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_ATOMIC, 1);
+    
+    drmModePlaneResPtr planes = drmModeGetPlaneResources(drm_fd);
+    if (!planes) {
+        printf("Failed to get DRM plane resources\n");
+        return 0;
+    }
+    
+    // First primary plane that is scanning out a framebuffer
+    for (uint32_t i = 0; i < planes->count_planes && plane_id == 0; i++) {
+        drmModePlanePtr plane = drmModeGetPlane(drm_fd, planes->planes[i]);
+        if (!plane) continue;
+        
+        uint64_t type = 0;
+        if (plane->fb_id && plane->crtc_id &&
+            find_property(plane->plane_id, DRM_MODE_OBJECT_PLANE, "type", &type) &&
+            type == DRM_PLANE_TYPE_PRIMARY) {
+            plane_id = plane->plane_id;
+        }
+        drmModeFreePlane(plane);
+    }
+    drmModeFreePlaneResources(planes);
+    
+    if (plane_id == 0) {
+        printf("No active primary plane found on %s\n", device);
+        return 0;
+    }
+    
+    damage_prop_id = find_property(plane_id, DRM_MODE_OBJECT_PLANE, "FB_DAMAGE_CLIPS", NULL);
+    
+    printf("DRM capture: %s, plane %u, damage clips %s\n", device, plane_id,
+           damage_prop_id ? "supported" : "not supported");
+    return 1;
+}
+
+// Release one cached framebuffer mapping
+static void unmap_fb(fb_map_t *fb) {
+    if (fb->map) munmap(fb->map, fb->map_size);
+    if (fb->prime_fd >= 0) close(fb->prime_fd);
+    fb->fb_id = 0;
+    fb->map = NULL;
+    fb->prime_fd = -1;
+}
+
+// Map a framebuffer through PRIME, or as a dumb buffer when export is not possible
+static int map_fb(fb_map_t *fb, uint32_t fb_id) {
+    drmModeFB2Ptr info = drmModeGetFB2(drm_fd, fb_id);
+    if (!info) {
+        printf("drmModeGetFB2 failed for fb %u\n", fb_id);
+        return 0;
+    }
+    
+    // Handles are only returned to DRM master or root
+    uint32_t handle = info->handles[0];
+    fb->width = info->width;
+    fb->height = info->height;
+    fb->pitch = info->pitches[0];
+    fb->offset = info->offsets[0];
+    fb->format = info->pixel_format;
+    drmModeFreeFB2(info);
+    
+    if (handle == 0) {
+        printf("No buffer handle for fb %u (run as root)\n", fb_id);
+        return 0;
+    }
+    
+    fb->map_size = (size_t)fb->pitch * fb->height + fb->offset;
+    fb->map = MAP_FAILED;
+    fb->prime_fd = -1;
+    
+    if (drmPrimeHandleToFD(drm_fd, handle, DRM_CLOEXEC, &fb->prime_fd) == 0) {
+        fb->map = mmap(NULL, fb->map_size, PROT_READ, MAP_SHARED, fb->prime_fd, 0);
+        if (fb->map == MAP_FAILED) {
+            close(fb->prime_fd);
+            fb->prime_fd = -1;
+        }
+    }
+    
+    if (fb->map == MAP_FAILED) {
+        struct drm_mode_map_dumb map_dumb = { .handle = handle };
+        if (drmIoctl(drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &map_dumb) == 0) {
+            fb->map = mmap(NULL, fb->map_size, PROT_READ, MAP_SHARED, drm_fd, map_dumb.offset);
+        }
+    }
+    
+    // The mapping keeps the buffer alive, the GEM handle is no longer needed
+    struct drm_gem_close gem_close = { .handle = handle };
+    drmIoctl(drm_fd, DRM_IOCTL_GEM_CLOSE, &gem_close);
+    
+    if (fb->map == MAP_FAILED) {
+        printf("Failed to map fb %u\n", fb_id);
+        fb->map = NULL;
+        return 0;
+    }
+    
+    if (fb->format != DRM_FORMAT_RGB565 && fb->format != DRM_FORMAT_XRGB8888 &&
+        fb->format != DRM_FORMAT_ARGB8888 && fb->format != DRM_FORMAT_XBGR8888 &&
+        fb->format != DRM_FORMAT_ABGR8888) {
+        printf("Unsupported framebuffer format 0x%08x\n", fb->format);
+        unmap_fb(fb);
+        return 0;
+    }
+    
+    fb->fb_id = fb_id;
+    return 1;
+}
+
+// Read the damage clips of the last commit, scaled to output pixels. Only the
+// last commit's clips can be seen: damage of commits in between, or of clients
+// drawing into the front buffer without committing, is missed until the
+// caller's periodic full diff (partial's DRM_DAMAGE_VERIFY_EVERY)
+static void read_damage(drm_damage_t *damage, uint32_t fb_id) {
+    damage->valid = 0;
+    damage->changed = 1;
+    
+    uint64_t blob_id = 0;
+    if (damage_prop_id == 0 ||
+        !find_property(plane_id, DRM_MODE_OBJECT_PLANE, "FB_DAMAGE_CLIPS", &blob_id) || blob_id == 0) {
+        // No clips on the last commit means the whole plane is damaged
+        last_damage_blob = 0;
+        return;
+    }
+    
+    // Another framebuffer was flipped in, it may hold damage from commits that
+    // were never seen, so the whole frame is read and diffed
+    if (fb_id != last_fb_id) {
+        last_damage_blob = blob_id;
+        return;
+    }
+    
+    // Same blob and framebuffer: nothing was committed since the last capture
+    if (blob_id == last_damage_blob && fb_id == last_fb_id) {
+        damage->valid = 1;
+        damage->changed = 0;
+        return;
+    }
+    last_damage_blob = blob_id;
+    
+    drmModePropertyBlobPtr blob = drmModeGetPropertyBlob(drm_fd, blob_id);
+    if (!blob) return;
+    
+    const struct drm_mode_rect *clips = blob->data;
+    int count = blob->length / sizeof(struct drm_mode_rect);
+    int x1 = current_fb->width, y1 = current_fb->height, x2 = 0, y2 = 0;
+    for (int i = 0; i < count; i++) {
+        if (clips[i].x1 < x1) x1 = clips[i].x1;
+        if (clips[i].y1 < y1) y1 = clips[i].y1;
+        if (clips[i].x2 > x2) x2 = clips[i].x2;
+        if (clips[i].y2 > y2) y2 = clips[i].y2;
+    }
+    drmModeFreePropertyBlob(blob);
+    
+    if (count == 0 || x2 <= x1 || y2 <= y1) return;
+    
+    damage->valid = 1;
+    damage->x1 = x1 * out_width / current_fb->width;
+    damage->y1 = y1 * out_height / current_fb->height;
+    damage->x2 = (x2 * out_width + current_fb->width - 1) / current_fb->width;
+    damage->y2 = (y2 * out_height + current_fb->height - 1) / current_fb->height;
+    if (damage->x2 > out_width) damage->x2 = out_width;
+    if (damage->y2 > out_height) damage->y2 = out_height;
+}
+
+// Map the framebuffer currently scanned out and fill in its damage
+int drm_capture_begin(drm_damage_t *damage) {
+    drmModePlanePtr plane = drmModeGetPlane(drm_fd, plane_id);
+    if (!plane) return -1;
+    uint32_t fb_id = plane->fb_id;
+    drmModeFreePlane(plane);
+    
+    if (fb_id == 0) {
+        printf("Plane %u has no framebuffer\n", plane_id);
+        return -1;
+    }
+    
+    // Reuse the mapping of a recently seen framebuffer
+    current_fb = NULL;
+    for (int i = 0; i < FB_CACHE_SIZE; i++) {
+        if (fb_cache[i].fb_id == fb_id) current_fb = &fb_cache[i];
+    }
+    
+    if (!current_fb) {
+        current_fb = &fb_cache[fb_cache_next];
+        fb_cache_next = (fb_cache_next + 1) % FB_CACHE_SIZE;
+        unmap_fb(current_fb);
+        if (!map_fb(current_fb, fb_id)) {
+            current_fb = NULL;
+            return -1;
+        }
+    }
+    
+    // Nearest neighbour column lookup for the scale down
+    if (x_lut_width != current_fb->width) {
+        free(x_lut);
+        x_lut = malloc(out_width * sizeof(int));
+        if (!x_lut) return -1;
+        for (int x = 0; x < out_width; x++) {
+            x_lut[x] = x * current_fb->width / out_width;
+        }
+        x_lut_width = current_fb->width;
+    }
+    
+    read_damage(damage, fb_id);
+    last_fb_id = fb_id;
+    
+    if (current_fb->prime_fd >= 0) {
+        struct dma_buf_sync sync = { .flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ };
+        ioctl(current_fb->prime_fd, DMA_BUF_IOCTL_SYNC, &sync);
+    }
+    
+    return 0;
+}
+
+// Copy output rows [y_start, y_end) as native endian RGB565 into their place in frame
+void drm_capture_rows(uint16_t *frame, int y_start, int y_end) {
+    fb_map_t *fb = current_fb;
+    
+    for (int y = y_start; y < y_end; y++) {
+        const uint8_t *src_row = fb->map + fb->offset + (size_t)(y * fb->height / out_height) * fb->pitch;
+        uint16_t *dst_row = frame + y * out_width;
+        
+        if (fb->format == DRM_FORMAT_RGB565) {
+            const uint16_t *src = (const uint16_t *)src_row;
+            for (int x = 0; x < out_width; x++) {
+                dst_row[x] = src[x_lut[x]];
+            }
+        } else {
+            // 32-bit formats, XRGB/ARGB have red in bits 16-23, XBGR/ABGR in bits 0-7
+            int red_shift = (fb->format == DRM_FORMAT_XRGB8888 || fb->format == DRM_FORMAT_ARGB8888) ? 16 : 0;
+            const uint32_t *src = (const uint32_t *)src_row;
+            for (int x = 0; x < out_width; x++) {
+                uint32_t p = src[x_lut[x]];
+                uint32_t r = (p >> red_shift) & 0xFF;
+                uint32_t g = (p >> 8) & 0xFF;
+                uint32_t b = (p >> (16 - red_shift)) & 0xFF;
+                dst_row[x] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+            }
+        }
+    }
+}
+
+// Finish CPU access to the current framebuffer
+void drm_capture_end(void) {
+    if (current_fb && current_fb->prime_fd >= 0) {
+        struct dma_buf_sync sync = { .flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ };
+        ioctl(current_fb->prime_fd, DMA_BUF_IOCTL_SYNC, &sync);
+    }
+}
+
+// Unmap framebuffers and close the DRM device
+void drm_capture_cleanup(void) {
+    if (drm_fd < 0) return;
+    
+    for (int i = 0; i < FB_CACHE_SIZE; i++) {
+        unmap_fb(&fb_cache[i]);
+    }
+    
+    free(x_lut);
+    x_lut = NULL;
+    
+    if (drm_fd >= 0) {
+        close(drm_fd);
+        drm_fd = -1;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef DRM_CAPTURE_H
+#define DRM_CAPTURE_H
+
+#include <stdint.h>
+
+// Damage reported by the compositor through the plane FB_DAMAGE_CLIPS property
+typedef struct {
+    int valid;           // 1 if damage clips were available for this capture
+    int changed;         // 0 if nothing was committed since the previous capture
+    int x1, y1, x2, y2;  // Bounding box of the clips in output pixels (x2/y2 exclusive)
+} drm_damage_t;
+
+// Open the DRM device and find the primary plane to capture, scaled to width x height
+int drm_capture_init(const char *device, int width, int height);
+
+// Map the framebuffer currently scanned out and fill in its damage. Returns 0 on success
+int drm_capture_begin(drm_damage_t *damage);
+
+// Copy output rows [y_start, y_end) as native endian RGB565 into their place in
+// frame, a full out_width x out_height image
+void drm_capture_rows(uint16_t *frame, int y_start, int y_end);
+
+// Finish CPU access to the framebuffer mapped by drm_capture_begin()
+void drm_capture_end(void);
+
+// Unmap framebuffers and close the DRM device
+void drm_capture_cleanup(void);
+
+#endif
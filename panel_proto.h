@@ -0,0 +1,136 @@
+#ifndef PANEL_PROTO_H
+#define PANEL_PROTO_H
+
+// Network panel protocol shared by partial (sender) and panel_server (receiver)
+//
+// Each message is a 16 byte header followed by payload_len bytes of payload.
+// All header fields are big endian. Pixels are 16-bit words in display byte
+// order, sent as-is. A RECT payload is RLE compressed as a sequence of packets,
+// each starting with a big endian 16-bit control word:
+//   bit 15 set   - run: (control & 0x7FFF) copies of the one pixel that follows
+//   bit 15 clear - literal: control pixels follow
+// After each FRAME_END the receiver replies with one ACK byte once the frame
+// is on the panel, the sender limits how many frames are waiting for an ACK.
+
+#include <stdint.h>
+#include <string.h>
+
+#define PANEL_PROTO_PORT 7789
+#define PANEL_PROTO_MAGIC0 'S'
+#define PANEL_PROTO_MAGIC1 'T'
+#define PANEL_PROTO_ACK 0x06
+
+// Message types
+#define PANEL_MSG_RECT 1       // Pixels for the window x_start,y_start - x_end,y_end (inclusive)
+#define PANEL_MSG_FRAME_END 2  // End of a frame, no payload
+
+#define PANEL_HEADER_SIZE 16
+#define PANEL_RLE_MAX_COUNT 0x7FFF
+
+// Worst case RLE payload size for a number of pixels (all literals)
+#define PANEL_RLE_MAX_BYTES(pixels) ((pixels) * 2 + (((pixels) + PANEL_RLE_MAX_COUNT - 1) / PANEL_RLE_MAX_COUNT) * 2)
+
+typedef struct {
+    uint8_t type;
+    uint16_t x_start, y_start, x_end, y_end;
+    uint32_t payload_len;
+} panel_msg_t;
+
+static inline void panel_put16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static inline uint16_t panel_get16(const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+// Serialize a message header into PANEL_HEADER_SIZE bytes
+static inline void panel_encode_header(uint8_t *out, const panel_msg_t *msg) {
+    out[0] = PANEL_PROTO_MAGIC0;
+    out[1] = PANEL_PROTO_MAGIC1;
+    out[2] = msg->type;
+    out[3] = 0;
+    panel_put16(out + 4, msg->x_start);
+    panel_put16(out + 6, msg->y_start);
+    panel_put16(out + 8, msg->x_end);
+    panel_put16(out + 10, msg->y_end);
+    panel_put16(out + 12, msg->payload_len >> 16);
+    panel_put16(out + 14, msg->payload_len & 0xFFFF);
+}
+
+// Parse a message header, returns 0 if the magic is wrong
+static inline int panel_decode_header(const uint8_t *in, panel_msg_t *msg) {
+    if (in[0] != PANEL_PROTO_MAGIC0 || in[1] != PANEL_PROTO_MAGIC1) return 0;
+    
+    msg->type = in[2];
+    msg->x_start = panel_get16(in + 4);
+    msg->y_start = panel_get16(in + 6);
+    msg->x_end = panel_get16(in + 8);
+    msg->y_end = panel_get16(in + 10);
+    msg->payload_len = ((uint32_t)panel_get16(in + 12) << 16) | panel_get16(in + 14);
+    return 1;
+}
+
+// RLE compress pixels into out (at least PANEL_RLE_MAX_BYTES(count) bytes), returns bytes written
+static inline uint32_t panel_rle_encode(const uint16_t *pixels, uint32_t count, uint8_t *out) {
+    uint8_t *p = out;
+    uint32_t i = 0;
+    
+    while (i < count) {
+        // Length of the run starting here
+        uint32_t run = 1;
+        while (i + run < count && run < PANEL_RLE_MAX_COUNT && pixels[i + run] == pixels[i]) run++;
+        
+        if (run >= 3) {
+            panel_put16(p, 0x8000 | run);
+            memcpy(p + 2, &pixels[i], 2);
+            p += 4;
+            i += run;
+            continue;
+        }
+        
+        // Literal up to the next run of 3 or more
+        uint32_t start = i;
+        while (i < count && i - start < PANEL_RLE_MAX_COUNT) {
+            if (i + 2 < count && pixels[i] == pixels[i + 1] && pixels[i] == pixels[i + 2]) break;
+            i++;
+        }
+        panel_put16(p, i - start);
+        memcpy(p + 2, &pixels[start], (i - start) * 2);
+        p += 2 + (i - start) * 2;
+    }
+    
+    return p - out;
+}
+
+// Expand an RLE payload into exactly count pixels, returns 0 on malformed input
+static inline int panel_rle_decode(const uint8_t *in, uint32_t len, uint16_t *pixels, uint32_t count) {
+    const uint8_t *end = in + len;
+    uint32_t o = 0;
+    
+    while (in + 2 <= end) {
+        uint16_t control = panel_get16(in);
+        uint32_t n = control & PANEL_RLE_MAX_COUNT;
+        in += 2;
+        
+        if (n > count - o) return 0;
+        
+        if (control & 0x8000) {
+            if (in + 2 > end) return 0;
+            uint16_t pixel;
+            memcpy(&pixel, in, 2);
+            for (uint32_t i = 0; i < n; i++) pixels[o + i] = pixel;
+            in += 2;
+        } else {
+            if (in + n * 2 > end) return 0;
+            memcpy(&pixels[o], in, n * 2);
+            in += n * 2;
+        }
+        o += n;
+    }
+    
+    return in == end && o == count;
+}
+
+#endif
@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "panel_proto.h"
+
+// Mock panel - build with "make panel_server MOCK=1" to test without a display.
+// Pixels go to an in-memory panel that is written out as a PPM after every frame
+#ifndef MOCK_PANEL
+#define MOCK_PANEL 0
+#endif
+
+#if !MOCK_PANEL
+#include <bcm2835.h>
+#endif
+
+// Display dimensions
+#define WIDTH 320
+#define HEIGHT 170
+#define DISPLAY_SIZE (WIDTH * HEIGHT)
+#define DISPLAY_BYTES (DISPLAY_SIZE * 2)
+
+// Display offset - ADJUSTED FOR YOUR DISPLAY
+#define COL_OFFSET 0
+#define ROW_OFFSET 35
+
+// GPIO pins
+#define DC_PIN RPI_GPIO_P1_18  // GPIO 24
+#define RST_PIN RPI_GPIO_P1_22 // GPIO 25
+#define CS_PIN RPI_GPIO_P1_24  // GPIO 8 (CE0)
+
+// SPI settings
+#define SPI_SPEED 32000000  // 32 MHz
+
+// Server settings
+#define SERVER_PORT PANEL_PROTO_PORT  // Overridden by the first command line argument
+#define MOCK_PANEL_DUMP "/tmp/panel.ppm"
+#define ACCEPT_RETRY_SECONDS 1  // Wait before accepting again when out of file descriptors or memory
+
+// Global variables
+volatile sig_atomic_t keep_running = 1;
+uint8_t *payload_buffer = NULL;
+uint16_t *pixel_buffer = NULL;
+
+#if MOCK_PANEL
+// Panel RAM and the write window/position of the mock panel
+uint16_t mock_ram[DISPLAY_SIZE];
+int mock_x_start, mock_y_start, mock_x_end, mock_y_end;
+int mock_x, mock_y;
+#endif
+
+// Function prototypes
+void init_gpio(void);
+void init_spi(void);
+void init_display(void);
+void write_command(uint8_t cmd);
+void write_data_len(const uint8_t *data, uint32_t len);
+void set_window(uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end);
+void clear_display(void);
+void dump_panel(void);
+int read_all(int fd, uint8_t *data, uint32_t len);
+void serve_client(int fd);
+void cleanup(void);
+void signal_handler(int sig);
+
+// Signal handler for clean exit
+void signal_handler(int sig) {
+    keep_running = 0;
+}
+
+#if MOCK_PANEL
+void init_gpio(void) {}
+void init_spi(void) {}
+void write_command(uint8_t cmd) {}
+
+// Write pixels into the mock panel RAM, wrapping inside the window like the controller
+void write_data_len(const uint8_t *data, uint32_t len) {
+    for (uint32_t i = 0; i + 1 < len; i += 2) {
+        if (mock_y > mock_y_end) break;
+        mock_ram[mock_y * WIDTH + mock_x] = (data[i] << 8) | data[i + 1];
+        if (++mock_x > mock_x_end) {
+            mock_x = mock_x_start;
+            mock_y++;
+        }
+    }
+}
+
+// Set the mock panel write window (no offsets, the mock RAM is the visible area)
+void set_window(uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end) {
+    mock_x_start = mock_x = x_start;
+    mock_y_start = mock_y = y_start;
+    mock_x_end = x_end;
+    mock_y_end = y_end;
+}
+
+void init_display(void) {
+    clear_display();
+}
+
+// Write the mock panel out as a binary PPM (renamed into place so readers never see half a file)
+void dump_panel(void) {
+    static uint8_t rgb[DISPLAY_SIZE * 3];
+    for (int i = 0; i < DISPLAY_SIZE; i++) {
+        uint16_t c = mock_ram[i];
+        rgb[i * 3] = ((c >> 11) & 0x1F) * 255 / 31;
+        rgb[i * 3 + 1] = ((c >> 5) & 0x3F) * 255 / 63;
+        rgb[i * 3 + 2] = (c & 0x1F) * 255 / 31;
+    }
+    
+    FILE *f = fopen(MOCK_PANEL_DUMP ".tmp", "wb");
+    if (!f) return;
+    fprintf(f, "P6\n%d %d\n255\n", WIDTH, HEIGHT);
+    fwrite(rgb, 1, sizeof(rgb), f);
+    fclose(f);
+    rename(MOCK_PANEL_DUMP ".tmp", MOCK_PANEL_DUMP);
+}
+#else
+// Display init sequence: command, argument count (| INIT_DELAY when a delay
+// in ms follows the arguments), arguments. Delays are the ST7789 datasheet minimums.
+#define INIT_DELAY 0x80
+static const uint8_t init_sequence[] = {
+    0x11, INIT_DELAY | 0, 5,     // Sleep Out, 5 ms before the next command
+    0x3A, 1, 0x55,               // Color Mode: 16-bit (RGB565)
+    0x36, 1, 0x60,               // MADCTL: MV=1, MX=1, MY=0 (270° rotation)
+    0x21, 0,                     // Display Inversion On
+};
+
+// Initialize GPIO
+void init_gpio(void) {
+    if (!bcm2835_init()) {
+        printf("Failed to initialize BCM2835\n");
+        exit(1);
+    }
+    
+    bcm2835_gpio_fsel(DC_PIN, BCM2835_GPIO_FSEL_OUTP);
+    bcm2835_gpio_fsel(RST_PIN, BCM2835_GPIO_FSEL_OUTP);
+    bcm2835_gpio_fsel(CS_PIN, BCM2835_GPIO_FSEL_OUTP);
+    
+    bcm2835_gpio_write(CS_PIN, HIGH);
+}
+
+// Initialize SPI with optimal settings
+void init_spi(void) {
+    bcm2835_spi_begin();
+    bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
+    bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);
+    bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_16);
+    bcm2835_spi_chipSelect(BCM2835_SPI_CS0);
+    bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);
+}
+
+// Write command to display
+void write_command(uint8_t cmd) {
+    bcm2835_gpio_write(DC_PIN, LOW);
+    bcm2835_gpio_write(CS_PIN, LOW);
+    bcm2835_spi_transfer(cmd);
+    bcm2835_gpio_write(CS_PIN, HIGH);
+}
+
+// Write multiple data bytes
+void write_data_len(const uint8_t *data, uint32_t len) {
+    bcm2835_gpio_write(DC_PIN, HIGH);
+    bcm2835_gpio_write(CS_PIN, LOW);
+    
+    // Transfer data
+    bcm2835_spi_writenb((char*)data, len);
+    
+    bcm2835_gpio_write(CS_PIN, HIGH);
+}
+
+// Set display window for a specific region
+void set_window(uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end) {
+    // Apply offsets
+    x_start += COL_OFFSET;
+    x_end += COL_OFFSET;
+    y_start += ROW_OFFSET;
+    y_end += ROW_OFFSET;
+    
+    // Column address set
+    uint8_t caset[4] = { x_start >> 8, x_start & 0xFF, x_end >> 8, x_end & 0xFF };
+    write_command(0x2A);
+    write_data_len(caset, sizeof(caset));
+    
+    // Row address set
+    uint8_t raset[4] = { y_start >> 8, y_start & 0xFF, y_end >> 8, y_end & 0xFF };
+    write_command(0x2B);
+    write_data_len(raset, sizeof(raset));
+    
+    // Memory write
+    write_command(0x2C);
+}
+
+// Initialize display with a table-driven command sequence and offset support
+void init_display(void) {
+    // Hardware reset: RESX low pulse needs >= 10 us, then 120 ms before Sleep Out
+    bcm2835_gpio_write(RST_PIN, LOW);
+    bcm2835_delayMicroseconds(20);
+    bcm2835_gpio_write(RST_PIN, HIGH);
+    bcm2835_delay(120);
+    
+    // Send initialization commands
+    const uint8_t *p = init_sequence;
+    const uint8_t *end = init_sequence + sizeof(init_sequence);
+    while (p < end) {
+        uint8_t cmd = *p++;
+        uint8_t flags = *p++;
+        uint8_t nargs = flags & ~INIT_DELAY;
+        
+        write_command(cmd);
+        if (nargs > 0) {
+            write_data_len(p, nargs);
+            p += nargs;
+        }
+        if (flags & INIT_DELAY) {
+            bcm2835_delay(*p++);
+        }
+    }
+    
+    clear_display();
+    
+    write_command(0x29);  // Display ON (no delay required before RAM writes)
+}
+
+void dump_panel(void) {}
+#endif
+
+// Clear display RAM to black - matches the all-black shadow a new sender starts from
+void clear_display(void) {
+    set_window(0, 0, WIDTH-1, HEIGHT-1);
+    memset(pixel_buffer, 0, DISPLAY_BYTES);
+    write_data_len((uint8_t*)pixel_buffer, DISPLAY_BYTES);
+}
+
+// Read exactly len bytes, returns 0 on success
+int read_all(int fd, uint8_t *data, uint32_t len) {
+    while (len > 0) {
+        ssize_t got = recv(fd, data, len, 0);
+        if (got < 0 && errno == EINTR && keep_running) continue;
+        if (got <= 0) return -1;
+        data += got;
+        len -= got;
+    }
+    return 0;
+}
+
+// Replay messages from one sender until it disconnects
+void serve_client(int fd) {
+    long frames = 0, rects = 0, bytes = 0;
+    uint8_t header[PANEL_HEADER_SIZE];
+    panel_msg_t msg;
+    
+    while (keep_running && read_all(fd, header, sizeof(header)) == 0) {
+        if (!panel_decode_header(header, &msg)) {
+            printf("Bad message header, dropping client\n");
+            break;
+        }
+        
+        if (msg.type == PANEL_MSG_FRAME_END) {
+            dump_panel();
+            
+            // Frame is on the panel, let the sender have another one in flight
+            uint8_t ack = PANEL_PROTO_ACK;
+            if (send(fd, &ack, 1, MSG_NOSIGNAL) != 1) break;
+            frames++;
+            continue;
+        }
+        
+        if (msg.type != PANEL_MSG_RECT ||
+            msg.x_start > msg.x_end || msg.x_end >= WIDTH ||
+            msg.y_start > msg.y_end || msg.y_end >= HEIGHT ||
+            msg.payload_len > PANEL_RLE_MAX_BYTES(DISPLAY_SIZE)) {
+            printf("Bad message (type %d), dropping client\n", msg.type);
+            break;
+        }
+        
+        uint32_t count = (msg.x_end - msg.x_start + 1) * (msg.y_end - msg.y_start + 1);
+        if (read_all(fd, payload_buffer, msg.payload_len) != 0) break;
+        if (!panel_rle_decode(payload_buffer, msg.payload_len, pixel_buffer, count)) {
+            printf("Bad RLE payload, dropping client\n");
+            break;
+        }
+        
+        set_window(msg.x_start, msg.y_start, msg.x_end, msg.y_end);
+        write_data_len((uint8_t*)pixel_buffer, count * 2);
+        rects++;
+        bytes += PANEL_HEADER_SIZE + msg.payload_len;
+    }
+    
+    printf("Client disconnected (Frames: %ld, Rects: %ld, Received: %ld KB)\n", frames, rects, bytes / 1024);
+}
+
+// Cleanup resources
+void cleanup(void) {
+    printf("Cleaning up resources...\n");
+    
+    free(payload_buffer);
+    free(pixel_buffer);
+    
+    #if !MOCK_PANEL
+    bcm2835_spi_end();
+    bcm2835_close();
+    #endif
+}
+
+// Main function
+int main(int argc, char *argv[]) {
+    int port = argc > 1 ? atoi(argv[1]) : SERVER_PORT;
+    
+    printf("Panel Server%s\n", MOCK_PANEL ? " (mock panel: " MOCK_PANEL_DUMP ")" : "");
+    printf("Display dimensions: %dx%d\n", WIDTH, HEIGHT);
+    
+    // Set up signal handler for clean exit - without SA_RESTART so a blocked
+    // accept() or recv() returns on Ctrl+C
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    
+    payload_buffer = malloc(PANEL_RLE_MAX_BYTES(DISPLAY_SIZE));
+    pixel_buffer = malloc(DISPLAY_BYTES);
+    if (!payload_buffer || !pixel_buffer) {
+        printf("Failed to allocate buffers\n");
+        cleanup();
+        return 1;
+    }
+    
+    init_gpio();
+    init_spi();
+    
+    printf("Initializing display...\n");
+    init_display();
+    printf("Display initialized\n");
+    
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        printf("Failed to create socket: %s\n", strerror(errno));
+        cleanup();
+        return 1;
+    }
+    
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 1) != 0) {
+        printf("Failed to listen on port %d\n", port);
+        close(listen_fd);
+        cleanup();
+        return 1;
+    }
+    
+    printf("Listening on port %d\n", port);
+    printf("Press Ctrl+C to exit\n");
+    
+    // One sender at a time
+    while (keep_running) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            
+            // Out of descriptors or memory: wait for some to be freed instead of spinning
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                printf("accept() failed: %s, retrying in %d s\n", strerror(errno), ACCEPT_RETRY_SECONDS);
+                sleep(ACCEPT_RETRY_SECONDS);
+                continue;
+            }
+            
+            printf("accept() failed: %s\n", strerror(errno));
+            break;
+        }
+        
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        printf("Client connected\n");
+        
+        // Each sender starts from a black shadow frame
+        clear_display();
+        serve_client(fd);
+        close(fd);
+    }
+    
+    close(listen_fd);
+    cleanup();
+    printf("Exited cleanly\n");
+    return 0;
+}
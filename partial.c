@@ -9,11 +9,32 @@
 #include <signal.h>
 #include <stddef.h>
 #include <sys/time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include "panel_proto.h"
 
+// Capture backend - build with "make DRM=1" on KMS systems (no dispmanx there)
+#ifndef CAPTURE_BACKEND_DRM
+#define CAPTURE_BACKEND_DRM 0
+#endif
+
+#if CAPTURE_BACKEND_DRM
+#include "drm_capture.h"
+#else
 // GPU acceleration headers
 #include <bcm_host.h>
 #include <interface/vmcs_host/vc_dispmanx.h>
 #include <interface/vctypes/vc_image_types.h>
+#include "dispmanx_map.h"
+#endif
 
 // Display dimensions
 #define WIDTH 320
@@ -41,15 +62,265 @@
 #define CHANGE_THRESHOLD 5    // Percentage of pixels that must change to trigger update
 #define MIN_UPDATE_REGION 10  // Minimum region size to update
 
+// Row hash change detection - SET TO 1 TO ENABLE, 0 TO DISABLE
+// Keeps a 64-bit hash per row segment instead of the previous and current
+// frames (a few KB instead of ~220 KB), changed rows are sent as bands.
+// The diff tolerance and the worker threads are not used in this mode
+#define ROW_HASH_ENABLED 0
+#define ROW_HASH_SEGMENTS 4         // Hashes per row, changed rows are sent only as wide as their changed segments
+#define ROW_HASH_BAND_ROWS 8        // Rows read and hashed at a time
+#define ROW_HASH_VERIFY_EVERY 60    // Resend every row every N frames (guards against hash collisions)
+#define SEGMENT_WIDTH (WIDTH / ROW_HASH_SEGMENTS)  // Must be a multiple of 4 pixels
+
+// Lossy diff tolerance - 0 = exact. Pixels whose R5/G6/B5 channels all changed
+// by no more than these amounts are not sent (noisy camera feeds, dithering)
+#define DIFF_TOLERANCE_R 0            // Red, 0-31
+#define DIFF_TOLERANCE_G 0            // Green, 0-63
+#define DIFF_TOLERANCE_B 0            // Blue, 0-31
+#define TOLERANCE_REFRESH_EVERY 60    // Exact diff every N frames to clean up residual error
+#define DIFF_TOLERANCE_ENABLED (DIFF_TOLERANCE_R || DIFF_TOLERANCE_G || DIFF_TOLERANCE_B)
+
+// Multi-core settings - number of threads is detected at runtime
+#define MAX_WORKERS 4  // Max threads converting/diffing bands (1 = always use the serial path)
+
+// Latest frame wins - SET TO 1 TO ENABLE, 0 TO DISABLE
+// The screen is captured in its own thread while the previous frame is sent. When
+// SPI can't keep up, captures are merged (newest pixels, union of the rows read)
+// and only the latest one is sent. Not used by the row hash mode
+#define LATEST_FRAME_WINS 1
+
+// GPU change probe - SET TO 1 TO ENABLE, 0 TO DISABLE
+// A tiny snapshot is compared first, only the bands it flags are read at full resolution
+#define PROBE_ENABLED 1
+#define PROBE_WIDTH 40
+#define PROBE_HEIGHT 22
+#define PROBE_FULL_EVERY 30  // Read the full frame every N frames (catches changes the probe averages away)
+
+// KMS/DRM capture settings (only used when built with DRM=1)
+#define DRM_DEVICE "/dev/dri/card0"   // With the vkms virtual driver this is usually card1
+#define DRM_DAMAGE_VERIFY_EVERY 30    // Ignore damage clips and diff the full frame every N frames (bounds how long missed damage stays)
+
+// Zero-copy capture - SET TO 1 TO ENABLE, 0 TO DISABLE
+// Snapshots are converted and diffed straight from the GPU memory of the
+// resource (needs root for /dev/mem), falls back to copying them out
+#define ZERO_COPY_ENABLED 1
+
+#if CAPTURE_BACKEND_DRM
+#undef PROBE_ENABLED
+#define PROBE_ENABLED 0  // The change probe needs dispmanx
+#endif
+
+// Multi-rate refresh - SET TO 1 TO ENABLE, 0 TO DISABLE
+// While typing, the rows around the text cursor are refreshed every frame and
+// the rest of the screen in round-robin slices
+#define MULTIRATE_ENABLED 1
+#define BACKGROUND_SLICES 4     // Rest of the screen is refreshed 1/N per frame while typing
+#define CURSOR_MARGIN_LINES 1   // Text lines above and below the cursor kept at full rate
+#define INPUT_ACTIVE_MS 500     // How long after the last key press the cursor area keeps priority
+#define VCSA_DEVICE "/dev/vcsa"
+#define MAX_INPUT_DEVICES 8
+
+// Cursor blink - SET TO 1 TO ENABLE, 0 TO DISABLE
+// Changes that fit in one character cell (the console cursor) are sent as a tiny
+// window, and once the cell under the console cursor (from /dev/vcsa) toggles
+// regularly the blink is replayed locally with no capture until a key is
+// pressed, the console changes or it is time to verify
+#define CURSOR_BLINK_ENABLED 1
+#define CURSOR_CELL_WIDTH 8       // Character cell size when /dev/vcsa is not available
+#define CURSOR_CELL_HEIGHT 16
+#define BLINK_LOCK_TOGGLES 4      // Regular toggles of the same cell before the blink is replayed
+#define BLINK_JITTER_MS 40        // Allowed deviation from the measured blink period
+#define BLINK_VERIFY_MS 5000      // Go back to capturing after this long to check the blink still matches
+#define BLINK_POLL_MS 20          // Console and keyboard polling interval while replaying
+#define BLINK_MAX_PIXELS 1024     // Largest cell tracked
+
+#define CONSOLE_INPUT_ENABLED (MULTIRATE_ENABLED || CURSOR_BLINK_ENABLED)
+
+// Network sink - SET TO 1 TO ENABLE, 0 TO DISABLE (or build with "make NET=1")
+// Updates are sent to panel_server instances instead of a local panel, so one
+// capture host can drive panels on several Pis
+#ifndef NET_SINK_ENABLED
+#define NET_SINK_ENABLED 0
+#endif
+#define NET_SINK_HOSTS "127.0.0.1"     // Comma separated, overridden by command line arguments
+#define NET_SINK_PORT PANEL_PROTO_PORT
+#define NET_MAX_INFLIGHT 2             // Frames not yet acknowledged before the sender waits
+#define MAX_NET_SINKS 8
+
+// Motion governor - SET TO 1 TO ENABLE, 0 TO DISABLE
+// During sustained motion the panel is switched to 12-bit color (RGB444, 25%
+// fewer bytes per pixel), once it settles it goes back to 16-bit with a full refresh
+#define GOVERNOR_ENABLED 1
+#define GOVERNOR_ENTER_PERCENT 30   // Changed pixels (% of the frame) counted as a busy frame
+#define GOVERNOR_ENTER_FRAMES 10    // Consecutive busy frames before switching to 12-bit
+#define GOVERNOR_LEAVE_PERCENT 5    // Changed pixels (% of the frame) counted as a calm frame
+#define GOVERNOR_SETTLE_FRAMES 30   // Consecutive calm frames before going back to 16-bit
+
+#if NET_SINK_ENABLED
+#undef GOVERNOR_ENABLED
+#define GOVERNOR_ENABLED 0  // Panel servers always get 16-bit pixels
+#endif
+
 // Global variables
 volatile sig_atomic_t keep_running = 1;
+#if !CAPTURE_BACKEND_DRM
 DISPMANX_DISPLAY_HANDLE_T display_handle = 0;
 DISPMANX_RESOURCE_HANDLE_T resource_handle = 0;
 VC_RECT_T rect;
+#endif
+struct timespec startup_time;
 
 // Previous frame buffer
 uint16_t *prev_frame = NULL;
 
+// Snapshot resource mapped into this process, NULL when snapshots are copied out
+const uint16_t *mapped_frame = NULL;
+
+// Rows read from the GPU this frame - the others still hold the previous frame
+uint8_t row_fresh[HEIGHT];
+
+// Set while the next capture must read every row (the periodic exact diff of
+// the tolerance), protected by capture_lock with the capture thread
+int full_read_due = 0;
+
+#if LATEST_FRAME_WINS
+// Capture thread state - everything below is protected by capture_lock
+pthread_t capture_thread;
+pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t capture_cond = PTHREAD_COND_INITIALIZER;
+uint16_t *capture_buffer = NULL;  // Newest raw pixels of every row
+uint8_t row_dirty[HEIGHT];        // Rows read since the last send
+int captures_pending = 0;         // Captures merged into capture_buffer since the last send
+int capture_running = 0;
+int capture_paused = 0;           // Set while the cursor blink is replayed
+volatile int capture_exit = 0;
+long superseded_frames = 0;       // Captures replaced by a newer one before being sent
+#endif
+
+#if PROBE_ENABLED
+DISPMANX_RESOURCE_HANDLE_T probe_resource_handle = 0;
+VC_RECT_T probe_rect;
+uint16_t probe_prev[PROBE_WIDTH * PROBE_HEIGHT];
+uint16_t probe_current[PROBE_WIDTH * PROBE_HEIGHT];
+#endif
+
+#if MULTIRATE_ENABLED
+// Rows scheduled for this frame, and changed rows still waiting for their slice
+uint8_t row_due[HEIGHT];
+uint8_t row_pending[HEIGHT];
+
+// Changed columns of every row this frame (min_x > max_x when nothing changed)
+int16_t row_min_x[HEIGHT];
+int16_t row_max_x[HEIGHT];
+#endif
+
+#if CONSOLE_INPUT_ENABLED
+// Console (for the cursor) and keyboards
+int vcsa_fd = -1;
+int input_fds[MAX_INPUT_DEVICES];
+int num_input_fds = 0;
+struct timespec last_input_time;
+#endif
+
+#if CURSOR_BLINK_ENABLED
+// Blink model: a cell-sized box alternating between two images at a regular period
+typedef struct {
+    int toggles;                  // Consecutive regular toggles seen, 0 = no model
+    int locked;                   // Replaying the blink instead of capturing
+    int min_x, max_x, min_y, max_y;
+    uint16_t phase[2][BLINK_MAX_PIXELS];  // The two images of the box (display format)
+    int shown;                    // Phase currently on the panel
+    long period_ms;
+    struct timespec last_toggle;
+} blink_t;
+
+blink_t blink;
+#endif
+
+#if NET_SINK_ENABLED
+// Connected panel servers - every one gets the same stream
+typedef struct {
+    int fd;
+    int inflight;  // Frames sent but not acknowledged yet
+} net_sink_t;
+
+net_sink_t net_sinks[MAX_NET_SINKS];
+int num_net_sinks = 0;
+uint8_t *net_buffer = NULL;  // Header + worst case RLE payload of a full frame
+int net_frame_rects = 0;     // Rectangles sent since the last frame end
+long net_bytes_sent = 0;
+#endif
+
+#if GOVERNOR_ENABLED
+int color_degraded = 0;               // Panel is in 12-bit mode
+int busy_frames = 0, calm_frames = 0;
+uint8_t rgb444_buffer[(DISPLAY_SIZE * 3 + 1) / 2];  // Rectangle packed two pixels in three bytes
+#endif
+
+#if ROW_HASH_ENABLED
+// Hash of every row segment as last sent to the panel
+uint64_t row_hashes[HEIGHT][ROW_HASH_SEGMENTS];
+#endif
+
+// Time spent detecting changes since the last FPS report
+long detect_ns = 0;
+
+// Damage summary of a frame (or of one band of it)
+typedef struct {
+    int changed_pixels;
+    int min_x, max_x;
+    int min_y, max_y;
+} damage_t;
+
+// Band worker - each one owns its rows and its damage summary, so no locking is needed
+typedef struct {
+    pthread_t thread;
+    sem_t start;
+    int y_start, y_end;
+    damage_t damage;
+} band_worker_t;
+
+band_worker_t band_workers[MAX_WORKERS];
+int num_bands = 1;
+sem_t band_done;
+volatile int workers_exit = 0;
+uint16_t *band_job_frame = NULL;
+
+// Merged damage of the last detected frame
+damage_t frame_damage;
+
+#if DIFF_TOLERANCE_ENABLED
+// Set on frames using the tolerance, cleared on the periodic exact refresh
+int tolerance_active = 0;
+#endif
+
+#if CAPTURE_BACKEND_DRM
+// Damage from the compositor's FB_DAMAGE_CLIPS for the last capture
+int damage_from_clips = 0;
+damage_t clip_damage;
+
+// Clip damage of the frame being sent - when set, the pixel diff is skipped
+int frame_from_clips = 0;
+damage_t frame_clip_damage;
+
+#if LATEST_FRAME_WINS
+// Union of the clip damage of the captures since the last send, cleared when
+// any of them had no usable clips (protected by capture_lock)
+int dirty_from_clips = 0;
+damage_t dirty_clip_damage;
+#endif
+#endif
+
+// Display init sequence: command, argument count (| INIT_DELAY when a delay
+// in ms follows the arguments), arguments. Delays are the ST7789 datasheet minimums.
+#define INIT_DELAY 0x80
+static const uint8_t init_sequence[] = {
+    0x11, INIT_DELAY | 0, 5,     // Sleep Out, 5 ms before the next command
+    0x3A, 1, 0x55,               // Color Mode: 16-bit (RGB565)
+    0x36, 1, 0x60,               // MADCTL: MV=1, MX=1, MY=0 (270° rotation)
+    0x21, 0,                     // Display Inversion On
+};
+
 // Function prototypes
 void init_gpio(void);
 void init_spi(void);
@@ -62,11 +333,50 @@ int init_gpu_resources(void);
 void display_framebuffer_smart_update(void);
 void cleanup(void);
 void signal_handler(int sig);
+void report_time_to_first_frame(void);
 uint16_t fix_color_format(uint16_t color);
-int detect_changed_regions(uint16_t *current_frame, uint16_t *update_mask);
-void update_changed_regions(uint16_t *current_frame, uint16_t *update_mask);
-void apply_interlacing(uint16_t *frame);
-void update_interlaced_regions(uint16_t *current_frame, uint16_t *update_mask);
+int detect_changed_regions(uint16_t *current_frame);
+void update_changed_regions(uint16_t *current_frame);
+void apply_interlacing(uint16_t *frame, int y_start, int y_end);
+void process_band(uint16_t *frame, int y_start, int y_end, damage_t *damage);
+int within_tolerance(uint16_t a, uint16_t b);
+void split_bands(int bands);
+void init_workers(void);
+void stop_workers(void);
+void update_interlaced_regions(uint16_t *current_frame);
+void update_fresh_runs(uint16_t *current_frame, int full_update);
+int read_band(uint16_t *frame, int y_start, int y_end);
+int read_rows(uint16_t *frame, uint8_t *fresh, int y_start, int y_end);
+int plan_capture(uint8_t *row_wanted, int full_read);
+int capture_frame(uint16_t *frame, uint8_t *fresh, int full_read);
+void update_tolerance(void);
+void *capture_thread_main(void *arg);
+int take_latest_capture(uint16_t *frame);
+void release_capture(void);
+void init_console_input(void);
+void init_multirate(void);
+int damage_fits_cell(const damage_t *damage);
+void track_blink(const uint16_t *current_frame, int full_update);
+int blink_at_cursor(void);
+void replay_blink(uint16_t *current_frame);
+void set_capture_paused(int paused);
+int input_recently_active(void);
+int read_cursor_rows(int *y_start, int *y_end);
+void schedule_rows(void);
+void send_rect(uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end, const uint16_t *pixels);
+int end_frame(void);
+void set_color_mode(int degraded);
+int governor_update(int changed_pixels);
+uint32_t pack_rgb444(const uint16_t *pixels, uint32_t count, uint8_t *out);
+int init_net_sinks(int argc, char *argv[]);
+int net_connect(const char *host);
+int net_send_all(int fd, const uint8_t *data, uint32_t len);
+void net_drop_sink(int index);
+void close_net_sinks(void);
+uint64_t hash_segment(const uint16_t *pixels);
+int update_hashed_rows(uint16_t *snapshot, uint16_t *band, uint16_t *region, const uint8_t *row_wanted, int verify);
+void display_framebuffer_row_hash(void);
+long elapsed_ns_since(const struct timespec *start);
 
 // Signal handler for clean exit
 void signal_handler(int sig) {
@@ -79,10 +389,10 @@ uint16_t fix_color_format(uint16_t color) {
     return ((color & 0xFF) << 8) | (color >> 8);
 }
 
-// Apply interlacing to frame - every other line becomes black
-void apply_interlacing(uint16_t *frame) {
+// Apply interlacing to rows of a frame - every other line becomes black
+void apply_interlacing(uint16_t *frame, int y_start, int y_end) {
     #if INTERLACE_ENABLED
-    for (int y = 0; y < HEIGHT; y++) {
+    for (int y = y_start; y < y_end; y++) {
         if (y % INTERLACE_EVERY == 1) {  // Make every other line black
             for (int x = 0; x < WIDTH; x++) {
                 frame[y * WIDTH + x] = 0x0000;  // Black
@@ -152,75 +462,199 @@ void set_window(uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_e
     y_end += ROW_OFFSET;
     
     // Column address set
+    uint8_t caset[4] = { x_start >> 8, x_start & 0xFF, x_end >> 8, x_end & 0xFF };
     write_command(0x2A);
-    write_data(x_start >> 8);
-    write_data(x_start & 0xFF);
-    write_data(x_end >> 8);
-    write_data(x_end & 0xFF);
+    write_data_len(caset, sizeof(caset));
     
     // Row address set
+    uint8_t raset[4] = { y_start >> 8, y_start & 0xFF, y_end >> 8, y_end & 0xFF };
     write_command(0x2B);
-    write_data(y_start >> 8);
-    write_data(y_start & 0xFF);
-    write_data(y_end >> 8);
-    write_data(y_end & 0xFF);
+    write_data_len(raset, sizeof(raset));
     
     // Memory write
     write_command(0x2C);
 }
 
-// Initialize display with optimized command sequence
-void init_display(void) {
-    // Reset display
-    bcm2835_gpio_write(RST_PIN, LOW);
-    bcm2835_delay(100);
-    bcm2835_gpio_write(RST_PIN, HIGH);
-    bcm2835_delay(100);
+// Send a rectangle of display format pixels (inclusive bounds) to the panel,
+// or to the panel servers when the network sink is enabled
+void send_rect(uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end, const uint16_t *pixels) {
+    uint32_t count = (x_end - x_start + 1) * (y_end - y_start + 1);
     
-    // Send initialization commands
-    write_command(0x01);  // SWRESET
-    bcm2835_delay(120);
+    #if NET_SINK_ENABLED
+    panel_msg_t msg = { PANEL_MSG_RECT, x_start, y_start, x_end, y_end, 0 };
+    msg.payload_len = panel_rle_encode(pixels, count, net_buffer + PANEL_HEADER_SIZE);
+    panel_encode_header(net_buffer, &msg);
     
-    write_command(0x11);  // Sleep Out
-    bcm2835_delay(120);
+    for (int i = 0; i < num_net_sinks; i++) {
+        if (net_send_all(net_sinks[i].fd, net_buffer, PANEL_HEADER_SIZE + msg.payload_len) != 0) {
+            net_drop_sink(i--);
+        }
+    }
+    net_bytes_sent += PANEL_HEADER_SIZE + msg.payload_len;
+    net_frame_rects++;
+    #else
+    set_window(x_start, y_start, x_end, y_end);
+    #if GOVERNOR_ENABLED
+    if (color_degraded) {
+        write_data_len(rgb444_buffer, pack_rgb444(pixels, count, rgb444_buffer));
+        return;
+    }
+    #endif
+    write_data_len((const uint8_t*)pixels, count * 2);
+    #endif
+}
+
+// Finish a frame - with the network sink, wait while too many frames are
+// unacknowledged so a slow panel server throttles capture. Returns 0 on success
+int end_frame(void) {
+    #if NET_SINK_ENABLED
+    if (net_frame_rects == 0) return num_net_sinks > 0 ? 0 : -1;
+    net_frame_rects = 0;
+    
+    uint8_t header[PANEL_HEADER_SIZE];
+    panel_msg_t msg = { PANEL_MSG_FRAME_END, 0, 0, 0, 0, 0 };
+    panel_encode_header(header, &msg);
     
-    write_command(0x3A);  // Color Mode
-    write_data(0x55);     // 16-bit (RGB565)
+    for (int i = 0; i < num_net_sinks; i++) {
+        net_sink_t *sink = &net_sinks[i];
+        if (net_send_all(sink->fd, header, sizeof(header)) != 0) {
+            net_drop_sink(i--);
+            continue;
+        }
+        sink->inflight++;
+        
+        // Collect acknowledgements, blocking only while the window is full
+        uint8_t acks[16];
+        while (sink->inflight > 0) {
+            int flags = sink->inflight >= NET_MAX_INFLIGHT ? 0 : MSG_DONTWAIT;
+            ssize_t len = recv(sink->fd, acks, sizeof(acks), flags);
+            if (len > 0) {
+                sink->inflight -= len;
+            } else if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else if (len < 0 && errno == EINTR) {
+                if (!keep_running) break;
+            } else {
+                net_drop_sink(i--);
+                break;
+            }
+        }
+    }
+    
+    if (num_net_sinks == 0) {
+        printf("No panel servers left\n");
+        return -1;
+    }
+    #endif
+    return 0;
+}
+
+#if GOVERNOR_ENABLED
+// Switch the panel between 16-bit (RGB565) and 12-bit (RGB444) pixels
+void set_color_mode(int degraded) {
+    write_command(0x3A);
+    write_data(degraded ? 0x53 : 0x55);
+    color_degraded = degraded;
+}
+
+// Count busy and calm frames, switching the color mode after enough of them in
+// a row. Returns 1 when back in 16-bit mode and the whole panel must be resent
+int governor_update(int changed_pixels) {
+    int percent = changed_pixels * 100 / DISPLAY_SIZE;
     
-    // MADCTL - Try different values
-    write_command(0x36);  // MADCTL
-    write_data(0x60);     // 270° rotation (landscape) - MY=1,MX=1,MV=1
+    if (!color_degraded) {
+        busy_frames = percent >= GOVERNOR_ENTER_PERCENT ? busy_frames + 1 : 0;
+        if (busy_frames >= GOVERNOR_ENTER_FRAMES) {
+            printf("Governor: sustained motion, switching to 12-bit color\n");
+            set_color_mode(1);
+            busy_frames = 0;
+            calm_frames = 0;
+        }
+        return 0;
+    }
     
-    write_command(0x21);  // Display Inversion On
+    calm_frames = percent <= GOVERNOR_LEAVE_PERCENT ? calm_frames + 1 : 0;
+    if (calm_frames >= GOVERNOR_SETTLE_FRAMES) {
+        printf("Governor: motion settled, back to 16-bit color\n");
+        set_color_mode(0);
+        return 1;
+    }
+    return 0;
+}
+
+// Pack display format (byte swapped RGB565) pixels into RGB444, two pixels in
+// three bytes. An odd last pixel takes two bytes, the spare nibble is dropped
+// by the panel when the next command starts. Returns the number of bytes written
+uint32_t pack_rgb444(const uint16_t *pixels, uint32_t count, uint8_t *out) {
+    uint8_t *p = out;
     
-    // Set column address with proper window
-    write_command(0x2A);
-    write_data(COL_OFFSET >> 8);
-    write_data(COL_OFFSET & 0xFF);
-    write_data((COL_OFFSET + WIDTH - 1) >> 8);
-    write_data((COL_OFFSET + WIDTH - 1) & 0xFF);
+    for (uint32_t i = 0; i < count; i += 2) {
+        uint16_t a = fix_color_format(pixels[i]);
+        uint16_t b = i + 1 < count ? fix_color_format(pixels[i + 1]) : 0;
+        *p++ = ((a >> 12) << 4) | ((a >> 7) & 0x0F);   // R1 G1
+        *p++ = (((a >> 1) & 0x0F) << 4) | (b >> 12);   // B1 R2
+        if (i + 1 < count) {
+            *p++ = (((b >> 7) & 0x0F) << 4) | ((b >> 1) & 0x0F);  // G2 B2
+        }
+    }
     
-    // Set row address with proper window
-    write_command(0x2B);
-    write_data(ROW_OFFSET >> 8);
-    write_data(ROW_OFFSET & 0xFF);
-    write_data((ROW_OFFSET + HEIGHT - 1) >> 8);
-    write_data((ROW_OFFSET + HEIGHT - 1) & 0xFF);
+    return p - out;
+}
+#endif
+
+// Initialize display with a table-driven command sequence and offset support
+void init_display(void) {
+    // Hardware reset: RESX low pulse needs >= 10 us, then 120 ms before Sleep Out
+    // (worst case, when the panel was left in Sleep Out by a previous run).
+    // A hardware reset makes SWRESET redundant, so it is not sent.
+    bcm2835_gpio_write(RST_PIN, LOW);
+    bcm2835_delayMicroseconds(20);
+    bcm2835_gpio_write(RST_PIN, HIGH);
+    bcm2835_delay(120);
     
-    write_command(0x29);  // Display ON
-    bcm2835_delay(100);
+    // Send initialization commands
+    const uint8_t *p = init_sequence;
+    const uint8_t *end = init_sequence + sizeof(init_sequence);
+    while (p < end) {
+        uint8_t cmd = *p++;
+        uint8_t flags = *p++;
+        uint8_t nargs = flags & ~INIT_DELAY;
+        
+        write_command(cmd);
+        if (nargs > 0) {
+            write_data_len(p, nargs);
+            p += nargs;
+        }
+        if (flags & INIT_DELAY) {
+            bcm2835_delay(*p++);
+        }
+    }
     
-    // Clear display to check alignment
+    // Clear display RAM before turning the panel on so no garbage is shown,
+    // using a single bulk transfer from a zeroed buffer
     set_window(0, 0, WIDTH-1, HEIGHT-1);
-    uint16_t black = 0x0000;
-    for (int i = 0; i < WIDTH * HEIGHT; i++) {
-        write_data(black >> 8);
-        write_data(black & 0xFF);
+    uint8_t *black = calloc(1, DISPLAY_BYTES);
+    if (black) {
+        write_data_len(black, DISPLAY_BYTES);
+        free(black);
+    } else {
+        // Fallback: clear row by row from a zeroed line
+        static const uint8_t black_line[WIDTH * 2];
+        for (int y = 0; y < HEIGHT; y++) {
+            write_data_len(black_line, sizeof(black_line));
+        }
     }
+    
+    write_command(0x29);  // Display ON (no delay required before RAM writes)
 }
 
 // Initialize GPU resources
 int init_gpu_resources(void) {
+    #if CAPTURE_BACKEND_DRM
+    if (!drm_capture_init(DRM_DEVICE, WIDTH, HEIGHT)) {
+        return 0;
+    }
+    #else
     bcm_host_init();
     
     // Get display size
@@ -238,12 +672,6 @@ int init_gpu_resources(void) {
     
     printf("Display size: %dx%d\n", display_info.width, display_info.height);
     
-    #if INTERLACE_ENABLED
-    printf("Interlacing: ENABLED (every %d lines)\n", INTERLACE_EVERY);
-    #else
-    printf("Interlacing: DISABLED\n");
-    #endif
-    
     // Create resource
     uint32_t vc_image_ptr;
     resource_handle = vc_dispmanx_resource_create(
@@ -261,6 +689,41 @@ int init_gpu_resources(void) {
     // Set up rectangle
     vc_dispmanx_rect_set(&rect, 0, 0, WIDTH, HEIGHT);
     
+    #if ZERO_COPY_ENABLED
+    mapped_frame = dispmanx_map_resource(display_handle, resource_handle, WIDTH, HEIGHT);
+    printf("Zero-copy capture: %s\n", mapped_frame ? "ENABLED" : "DISABLED (copying snapshots)");
+    #endif
+    
+    #if PROBE_ENABLED
+    // Create the low resolution change probe resource
+    probe_resource_handle = vc_dispmanx_resource_create(
+        VC_IMAGE_RGB565,
+        PROBE_WIDTH,
+        PROBE_HEIGHT,
+        &vc_image_ptr
+    );
+    
+    if (probe_resource_handle == 0) {
+        printf("Failed to create probe resource\n");
+        return 0;
+    }
+    
+    vc_dispmanx_rect_set(&probe_rect, 0, 0, PROBE_WIDTH, PROBE_HEIGHT);
+    printf("Change probe: ENABLED (%dx%d)\n", PROBE_WIDTH, PROBE_HEIGHT);
+    #else
+    printf("Change probe: DISABLED\n");
+    #endif
+    #endif
+    
+    #if INTERLACE_ENABLED
+    printf("Interlacing: ENABLED (every %d lines)\n", INTERLACE_EVERY);
+    #else
+    printf("Interlacing: DISABLED\n");
+    #endif
+    
+    #if ROW_HASH_ENABLED
+    printf("Change detection: row hashes\n");
+    #else
     // Allocate previous frame buffer
     prev_frame = malloc(DISPLAY_BYTES);
     if (!prev_frame) {
@@ -268,132 +731,962 @@ int init_gpu_resources(void) {
         return 0;
     }
     memset(prev_frame, 0, DISPLAY_BYTES);
+    #endif
     
     return 1;
 }
 
-// Detect changed regions between frames
-int detect_changed_regions(uint16_t *current_frame, uint16_t *update_mask) {
-    int changed_pixels = 0;
+// Convert, diff and summarize the damage of rows [y_start, y_end)
+void process_band(uint16_t *frame, int y_start, int y_end, damage_t *damage) {
+    damage->changed_pixels = 0;
+    damage->min_x = WIDTH;
+    damage->max_x = 0;
+    damage->min_y = HEIGHT;
+    damage->max_y = 0;
     
-    // Simple diff - mark changed pixels
-    for (int i = 0; i < DISPLAY_SIZE; i++) {
-        if (current_frame[i] != prev_frame[i]) {
-            update_mask[i] = 1;
-            changed_pixels++;
-        } else {
-            update_mask[i] = 0;
+    for (int y = y_start; y < y_end; y++) {
+        #if MULTIRATE_ENABLED
+        row_min_x[y] = WIDTH;
+        row_max_x[y] = -1;
+        #endif
+        
+        // Rows not read this frame are unchanged
+        if (!row_fresh[y]) continue;
+        
+        // Apply color correction, straight from the snapshot when it is mapped
+        const uint16_t *src = mapped_frame ? &mapped_frame[y * WIDTH] : &frame[y * WIDTH];
+        for (int x = 0; x < WIDTH; x++) {
+            frame[y * WIDTH + x] = fix_color_format(src[x]);
+        }
+        
+        // Apply interlacing if enabled
+        apply_interlacing(frame, y, y + 1);
+        
+        #if CAPTURE_BACKEND_DRM
+        // Damage is already known from the compositor
+        if (frame_from_clips) {
+            #if MULTIRATE_ENABLED
+            row_min_x[y] = frame_clip_damage.min_x;
+            row_max_x[y] = frame_clip_damage.max_x;
+            #endif
+            continue;
+        }
+        #endif
+        
+        // Simple diff - count changed pixels and track their bounding box
+        for (int x = 0; x < WIDTH; x++) {
+            int idx = y * WIDTH + x;
+            #if DIFF_TOLERANCE_ENABLED
+            // Noise-level change: keep what the panel already shows, so the
+            // previous frame stays an exact copy of the panel and errors can't add up
+            if (tolerance_active && frame[idx] != prev_frame[idx] &&
+                within_tolerance(frame[idx], prev_frame[idx])) {
+                frame[idx] = prev_frame[idx];
+            }
+            #endif
+            if (frame[idx] != prev_frame[idx]) {
+                damage->changed_pixels++;
+                if (x < damage->min_x) damage->min_x = x;
+                if (x > damage->max_x) damage->max_x = x;
+                if (y < damage->min_y) damage->min_y = y;
+                if (y > damage->max_y) damage->max_y = y;
+                #if MULTIRATE_ENABLED
+                if (x < row_min_x[y]) row_min_x[y] = x;
+                if (x > row_max_x[y]) row_max_x[y] = x;
+                #endif
+            }
         }
     }
+}
+
+// Check if two display format pixels differ by no more than the per-channel tolerance
+int within_tolerance(uint16_t a, uint16_t b) {
+    a = fix_color_format(a);
+    b = fix_color_format(b);
     
-    // Calculate change percentage
-    float change_percent = (changed_pixels * 100.0f) / DISPLAY_SIZE;
+    int dr = (a >> 11) - (b >> 11);
+    int dg = ((a >> 5) & 0x3F) - ((b >> 5) & 0x3F);
+    int db = (a & 0x1F) - (b & 0x1F);
     
-    // If too many changes, just update the whole screen
-    if (change_percent > CHANGE_THRESHOLD) {
-        return 1; // Full update
+    return abs(dr) <= DIFF_TOLERANCE_R && abs(dg) <= DIFF_TOLERANCE_G && abs(db) <= DIFF_TOLERANCE_B;
+}
+
+// Band worker thread - waits for a frame, processes its band, repeats
+void *band_worker_main(void *arg) {
+    band_worker_t *worker = arg;
+    
+    while (1) {
+        sem_wait(&worker->start);
+        if (workers_exit) break;
+        
+        process_band(band_job_frame, worker->y_start, worker->y_end, &worker->damage);
+        
+        sem_post(&band_done);
     }
     
-    return 0; // Partial update
+    return NULL;
 }
 
-// Update only the changed regions with interlacing support
-void update_changed_regions(uint16_t *current_frame, uint16_t *update_mask) {
-    // For simplicity, we'll find the bounding box of changed areas
-    // and update rectangular regions
+// Split the frame into horizontal bands, one per thread
+void split_bands(int bands) {
+    int rows_per_band = HEIGHT / bands;
+    for (int i = 0; i < bands; i++) {
+        band_workers[i].y_start = i * rows_per_band;
+        band_workers[i].y_end = (i == bands - 1) ? HEIGHT : (i + 1) * rows_per_band;
+    }
+    num_bands = bands;
+}
+
+// Start one worker thread per extra core
+void init_workers(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int bands = cores < 1 ? 1 : (cores > MAX_WORKERS ? MAX_WORKERS : cores);
     
-    int min_x = WIDTH, max_x = 0;
-    int min_y = HEIGHT, max_y = 0;
-    int changed_areas = 0;
+    // Single core (Pi 1): keep the serial path, no threads
+    split_bands(1);
+    if (bands == 1) {
+        printf("Workers: serial (cores: %ld)\n", cores);
+        return;
+    }
     
-    // Find bounding box of changes
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            int idx = y * WIDTH + x;
-            if (update_mask[idx]) {
-                if (x < min_x) min_x = x;
-                if (x > max_x) max_x = x;
-                if (y < min_y) min_y = y;
-                if (y > max_y) max_y = y;
-                changed_areas++;
-            }
+    sem_init(&band_done, 0, 0);
+    
+    // Band 0 is processed by the calling thread
+    int started = 1;
+    for (int i = 1; i < bands; i++) {
+        sem_init(&band_workers[i].start, 0, 0);
+        if (pthread_create(&band_workers[i].thread, NULL, band_worker_main, &band_workers[i]) != 0) {
+            printf("Failed to start worker thread %d\n", i);
+            sem_destroy(&band_workers[i].start);
+            break;
         }
+        started++;
     }
     
-    // If we found a reasonable changed area, update it
-    if (changed_areas > MIN_UPDATE_REGION && 
-        (max_x - min_x) > 2 && (max_y - min_y) > 2) {
-        
-        // Set window to changed region
-        set_window(min_x, min_y, max_x, max_y);
-        
-        // Extract and send only the changed region
-        int region_width = max_x - min_x + 1;
-        int region_height = max_y - min_y + 1;
-        int region_size = region_width * region_height;
-        
-        uint16_t *region_buffer = malloc(region_size * 2);
-        if (!region_buffer) {
-            // Fallback to full update if memory allocation fails
-            set_window(0, 0, WIDTH-1, HEIGHT-1);
-            write_data_len((uint8_t*)current_frame, DISPLAY_BYTES);
-            return;
+    split_bands(started);
+    printf("Workers: %d (cores: %ld)\n", num_bands, cores);
+}
+
+// Stop and join the worker threads
+void stop_workers(void) {
+    workers_exit = 1;
+    for (int i = 1; i < num_bands; i++) {
+        sem_post(&band_workers[i].start);
+        pthread_join(band_workers[i].thread, NULL);
+        sem_destroy(&band_workers[i].start);
+    }
+    if (num_bands > 1) {
+        sem_destroy(&band_done);
+    }
+    split_bands(1);
+}
+
+// Read full resolution rows [y_start, y_end) of the last snapshot into their
+// place in frame - it must be a full height image, the dispmanx read always
+// writes row y at frame + y * pitch (and ignores the rect's x)
+int read_band(uint16_t *frame, int y_start, int y_end) {
+    #if CAPTURE_BACKEND_DRM
+    drm_capture_rows(frame, y_start, y_end);
+    #else
+    VC_RECT_T band_rect;
+    
+    // Reads always start at x = 0
+    vc_dispmanx_rect_set(&band_rect, 0, y_start, WIDTH, y_end - y_start);
+    if (vc_dispmanx_resource_read_data(resource_handle, &band_rect, frame, WIDTH * 2) != 0) {
+        return -1;
+    }
+    #endif
+    
+    return 0;
+}
+
+// Read full resolution rows [y_start, y_end) of the last snapshot into frame and
+// flag them in fresh (nothing to copy when the snapshot is mapped, it is read there)
+int read_rows(uint16_t *frame, uint8_t *fresh, int y_start, int y_end) {
+    if (!mapped_frame && read_band(frame, y_start, y_end) != 0) {
+        return -1;
+    }
+    
+    memset(&fresh[y_start], 1, y_end - y_start);
+    return 0;
+}
+
+// Pick the rows to read this frame and take the full resolution snapshot -
+// with the probe enabled (or damage clips on KMS), only the bands flagged as
+// changed are wanted, and with multi-rate refresh only the rows scheduled for
+// this frame. full_read wants every row whatever the probe, clips or schedule say.
+// Returns 1 when rows are wanted, 0 when there is nothing to read and -1 on error
+int plan_capture(uint8_t *row_wanted, int full_read) {
+    #if CAPTURE_BACKEND_DRM
+    static long drm_frames = 0;
+    drm_damage_t damage;
+    
+    // Map the current scanout buffer and get the compositor's damage
+    if (drm_capture_begin(&damage) != 0) {
+        printf("DRM capture failed\n");
+        return -1;
+    }
+    
+    damage_from_clips = damage.valid && (drm_frames++ % DRM_DAMAGE_VERIFY_EVERY) != 0 && !full_read;
+    if (damage_from_clips) {
+        memset(row_wanted, 0, HEIGHT);
+        if (damage.changed) {
+            memset(&row_wanted[damage.y1], 1, damage.y2 - damage.y1);
         }
-        
-        // Copy changed region
-        for (int y = min_y; y <= max_y; y++) {
-            for (int x = min_x; x <= max_x; x++) {
-                int src_idx = y * WIDTH + x;
-                int dst_idx = (y - min_y) * region_width + (x - min_x);
-                region_buffer[dst_idx] = current_frame[src_idx];
-            }
+    } else {
+        memset(row_wanted, 1, HEIGHT);
+    }
+    #elif PROBE_ENABLED
+    static long probe_frames = 0;
+    if ((probe_frames++ % PROBE_FULL_EVERY) == 0) {
+        full_read = 1;
+    }
+    
+    // Cheap snapshot first
+    if (vc_dispmanx_snapshot(display_handle, probe_resource_handle, 0) != 0 ||
+        vc_dispmanx_resource_read_data(probe_resource_handle, &probe_rect, probe_current, PROBE_WIDTH * 2) != 0) {
+        printf("Probe snapshot failed\n");
+        return -1;
+    }
+    
+    if (full_read) {
+        memset(row_wanted, 1, HEIGHT);
+    } else {
+        // Flag the rows under changed probe rows, widened by a row on each
+        // side since the scaler filter blends neighbouring rows
+        memset(row_wanted, 0, HEIGHT);
+        for (int py = 0; py < PROBE_HEIGHT; py++) {
+            if (memcmp(&probe_current[py * PROBE_WIDTH], &probe_prev[py * PROBE_WIDTH],
+                       PROBE_WIDTH * sizeof(uint16_t)) == 0) continue;
+            
+            int y_start = py * HEIGHT / PROBE_HEIGHT - 1;
+            int y_end = ((py + 1) * HEIGHT + PROBE_HEIGHT - 1) / PROBE_HEIGHT + 1;
+            if (y_start < 0) y_start = 0;
+            if (y_end > HEIGHT) y_end = HEIGHT;
+            memset(&row_wanted[y_start], 1, y_end - y_start);
         }
-        
-        // Send region data
-        write_data_len((uint8_t*)region_buffer, region_size * 2);
-        free(region_buffer);
-        
-        printf("Partial update: Region %d,%d to %d,%d (%d pixels)\n", 
-               min_x, min_y, max_x, max_y, region_size);
-    } else if (changed_areas > 0) {
-        // Small changes, do full update for simplicity
-        set_window(0, 0, WIDTH-1, HEIGHT-1);
-        write_data_len((uint8_t*)current_frame, DISPLAY_BYTES);
     }
-    // Else: no changes, no update needed
+    memcpy(probe_prev, probe_current, sizeof(probe_prev));
+    #else
+    memset(row_wanted, 1, HEIGHT);
+    #endif
+    
+    #if MULTIRATE_ENABLED
+    // Changed rows that are not due this frame wait for their slice
+    for (int y = 0; y < HEIGHT; y++) {
+        #if CAPTURE_BACKEND_DRM
+        // Rows left over from earlier frames are outside this frame's clips
+        if (row_pending[y] && row_due[y]) damage_from_clips = 0;
+        #endif
+        row_wanted[y] |= row_pending[y];
+        row_pending[y] = row_wanted[y] && !row_due[y] && !full_read;
+        row_wanted[y] &= row_due[y] || full_read;
+    }
+    #endif
+    
+    // Nothing to read: skip the full resolution snapshot entirely
+    int any_wanted = 0;
+    int wanted_min_y = HEIGHT, wanted_max_y = 0;
+    for (int y = 0; y < HEIGHT; y++) {
+        if (!row_wanted[y]) continue;
+        any_wanted = 1;
+        if (y < wanted_min_y) wanted_min_y = y;
+        wanted_max_y = y;
+    }
+    
+    #if CAPTURE_BACKEND_DRM
+    if (damage_from_clips) {
+        // Clip bounding box limited to the rows read this frame
+        clip_damage.min_x = damage.x1;
+        clip_damage.max_x = damage.x2 - 1;
+        clip_damage.min_y = wanted_min_y;
+        clip_damage.max_y = wanted_max_y;
+        clip_damage.changed_pixels = any_wanted ?
+            (damage.x2 - damage.x1) * (wanted_max_y - wanted_min_y + 1) : 0;
+    }
+    #else
+    (void)wanted_min_y;
+    (void)wanted_max_y;
+    #endif
+    
+    if (!any_wanted) {
+        #if CAPTURE_BACKEND_DRM
+        drm_capture_end();
+        #endif
+        return 0;
+    }
+    
+    #if !CAPTURE_BACKEND_DRM
+    // GPU-accelerated snapshot
+    if (vc_dispmanx_snapshot(display_handle, resource_handle, 0) != 0) {
+        printf("Dispmanx snapshot failed\n");
+        return -1;
+    }
+    #endif
+    
+    return 1;
 }
 
-// Update interlaced regions - optimized for speed
-void update_interlaced_regions(uint16_t *current_frame, uint16_t *update_mask) {
-    #if INTERLACE_ENABLED
-    // For interlaced mode, we update non-black lines only
-    int min_x = WIDTH, max_x = 0;
-    int min_y = HEIGHT, max_y = 0;
-    int changed_areas = 0;
+// Capture the wanted rows of the screen into frame (every row with full_read),
+// flagging them in fresh. Returns 0 on success
+int capture_frame(uint16_t *frame, uint8_t *fresh, int full_read) {
+    uint8_t row_wanted[HEIGHT];
+    memset(fresh, 0, HEIGHT);
+    
+    int planned = plan_capture(row_wanted, full_read);
+    if (planned <= 0) {
+        return planned;
+    }
     
-    // Find bounding box of changes, skipping black lines
+    // Read the wanted rows, one band per run
+    int result = 0;
     for (int y = 0; y < HEIGHT; y++) {
-        // Skip black lines in interlaced mode
-        if (y % INTERLACE_EVERY == 1) continue;
+        if (!row_wanted[y]) continue;
         
-        for (int x = 0; x < WIDTH; x++) {
-            int idx = y * WIDTH + x;
-            if (update_mask[idx]) {
-                if (x < min_x) min_x = x;
-                if (x > max_x) max_x = x;
-                if (y < min_y) min_y = y;
-                if (y > max_y) max_y = y;
-                changed_areas++;
-            }
+        int y_end = y + 1;
+        while (y_end < HEIGHT && row_wanted[y_end]) y_end++;
+        
+        if (read_rows(frame, fresh, y, y_end) != 0) {
+            printf("Failed to read resource data\n");
+            result = -1;
+            break;
         }
+        
+        y = y_end;
     }
     
-    // If we found a reasonable changed area, update it
-    if (changed_areas > MIN_UPDATE_REGION && 
-        (max_x - min_x) > 2 && (max_y - min_y) > 2) {
+    #if CAPTURE_BACKEND_DRM
+    drm_capture_end();
+    #endif
+    
+    return result;
+}
+
+#if LATEST_FRAME_WINS
+// Capture thread - keeps capturing while the sender is busy, merging the rows
+// read into the newest frame until the sender takes it
+void *capture_thread_main(void *arg) {
+    uint8_t fresh[HEIGHT];
+    
+    while (!capture_exit && keep_running) {
+        pthread_mutex_lock(&capture_lock);
         
-        // Set window to changed region
-        set_window(min_x, min_y, max_x, max_y);
+        // Nothing is captured while the cursor blink is replayed
+        while (capture_paused && !capture_exit && keep_running) {
+            pthread_cond_wait(&capture_cond, &capture_lock);
+        }
+        
+        #if MULTIRATE_ENABLED
+        // Pick the rows refreshed by the next sent frame - the slice only moves on
+        // once the sender took the capture, or the captures it merges would cover
+        // several slices
+        if (captures_pending == 0) {
+            schedule_rows();
+        }
+        #endif
+        
+        int result = capture_frame(capture_buffer, fresh, full_read_due);
+        if (result == 0 && memchr(fresh, 1, HEIGHT) != NULL) {
+            for (int y = 0; y < HEIGHT; y++) {
+                row_dirty[y] |= fresh[y];
+            }
+            
+            #if CAPTURE_BACKEND_DRM
+            // Merge the compositor's damage, the frame is diffed if any capture had no clips
+            if (captures_pending == 0) {
+                dirty_from_clips = damage_from_clips;
+                dirty_clip_damage = clip_damage;
+            } else if (dirty_from_clips && damage_from_clips) {
+                damage_t *dirty = &dirty_clip_damage;
+                if (clip_damage.min_x < dirty->min_x) dirty->min_x = clip_damage.min_x;
+                if (clip_damage.max_x > dirty->max_x) dirty->max_x = clip_damage.max_x;
+                if (clip_damage.min_y < dirty->min_y) dirty->min_y = clip_damage.min_y;
+                if (clip_damage.max_y > dirty->max_y) dirty->max_y = clip_damage.max_y;
+                dirty->changed_pixels = (dirty->max_x - dirty->min_x + 1) * (dirty->max_y - dirty->min_y + 1);
+            } else {
+                dirty_from_clips = 0;
+            }
+            #endif
+            
+            if (captures_pending++ > 0) {
+                superseded_frames++;
+            }
+            pthread_cond_broadcast(&capture_cond);
+        }
+        pthread_mutex_unlock(&capture_lock);
+        
+        if (result != 0) {
+            break;
+        }
+        
+        // Small sleep to prevent 100% CPU usage
+        usleep(2000);
+    }
+    
+    pthread_mutex_lock(&capture_lock);
+    capture_running = 0;
+    pthread_cond_broadcast(&capture_cond);
+    pthread_mutex_unlock(&capture_lock);
+    return NULL;
+}
+
+// Wait for a capture and take the newest pixels of every row read since the
+// last send into frame. A mapped snapshot is not copied: it is converted in
+// place and capture_lock stays held until release_capture(), so the next
+// snapshot can't overwrite it meanwhile. Returns 0 on success, -1 once the
+// capture thread stopped
+int take_latest_capture(uint16_t *frame) {
+    pthread_mutex_lock(&capture_lock);
+    while (captures_pending == 0 && capture_running) {
+        pthread_cond_wait(&capture_cond, &capture_lock);
+    }
+    
+    if (captures_pending == 0) {
+        pthread_mutex_unlock(&capture_lock);
+        return -1;
+    }
+    
+    for (int y = 0; y < HEIGHT; y++) {
+        row_fresh[y] = row_dirty[y];
+        if (row_dirty[y] && !mapped_frame) {
+            memcpy(&frame[y * WIDTH], &capture_buffer[y * WIDTH], WIDTH * sizeof(uint16_t));
+        }
+    }
+    memset(row_dirty, 0, HEIGHT);
+    captures_pending = 0;
+    update_tolerance();
+    
+    #if CAPTURE_BACKEND_DRM
+    frame_from_clips = dirty_from_clips;
+    frame_clip_damage = dirty_clip_damage;
+    #endif
+    
+    if (!mapped_frame) {
+        pthread_mutex_unlock(&capture_lock);
+    }
+    return 0;
+}
+
+// Let the capture thread take the next snapshot once the mapped one is converted
+void release_capture(void) {
+    if (mapped_frame) {
+        pthread_mutex_unlock(&capture_lock);
+    }
+}
+#endif
+
+#if CONSOLE_INPUT_ENABLED
+// Open the console (for the cursor position) and the keyboard input devices
+void init_console_input(void) {
+    vcsa_fd = open(VCSA_DEVICE, O_RDONLY);
+    if (vcsa_fd < 0) {
+        printf("Failed to open %s, cursor position not available\n", VCSA_DEVICE);
+    }
+    
+    DIR *dir = opendir("/dev/input");
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL && num_input_fds < MAX_INPUT_DEVICES) {
+            if (strncmp(entry->d_name, "event", 5) != 0) continue;
+            
+            char path[64];
+            snprintf(path, sizeof(path), "/dev/input/%s", entry->d_name);
+            int fd = open(path, O_RDONLY | O_NONBLOCK);
+            if (fd < 0) continue;
+            
+            // Only keep devices reporting key events
+            unsigned long ev_bits = 0;
+            if (ioctl(fd, EVIOCGBIT(0, sizeof(ev_bits)), &ev_bits) < 0 || !(ev_bits & (1UL << EV_KEY))) {
+                close(fd);
+                continue;
+            }
+            input_fds[num_input_fds++] = fd;
+        }
+        closedir(dir);
+    }
+}
+
+// Drain pending input events, returns 1 if a key was pressed within INPUT_ACTIVE_MS
+int input_recently_active(void) {
+    struct input_event events[16];
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    for (int i = 0; i < num_input_fds; i++) {
+        ssize_t len;
+        while ((len = read(input_fds[i], events, sizeof(events))) > 0) {
+            for (int e = 0; e < len / (ssize_t)sizeof(struct input_event); e++) {
+                if (events[e].type == EV_KEY && events[e].value != 0) {
+                    last_input_time = now;
+                }
+            }
+        }
+    }
+    
+    if (last_input_time.tv_sec == 0 && last_input_time.tv_nsec == 0) {
+        return 0;
+    }
+    
+    long elapsed_ms = (now.tv_sec - last_input_time.tv_sec) * 1000 +
+                      (now.tv_nsec - last_input_time.tv_nsec) / 1000000;
+    return elapsed_ms <= INPUT_ACTIVE_MS;
+}
+#endif
+
+#if MULTIRATE_ENABLED
+// Start with every row due
+void init_multirate(void) {
+    memset(row_due, 1, HEIGHT);
+    printf("Multi-rate refresh: ENABLED (%d input devices, 1/%d background slices)\n",
+           num_input_fds, BACKGROUND_SLICES);
+}
+
+// Frame rows covered by the text line holding the cursor (plus margin lines)
+int read_cursor_rows(int *y_start, int *y_end) {
+    // /dev/vcsa header: lines, columns, cursor x, cursor y
+    uint8_t header[4];
+    if (vcsa_fd < 0 || pread(vcsa_fd, header, sizeof(header), 0) != sizeof(header) || header[0] == 0) {
+        return 0;
+    }
+    
+    int lines = header[0];
+    int cursor_line = header[3];
+    *y_start = (cursor_line - CURSOR_MARGIN_LINES) * HEIGHT / lines;
+    *y_end = ((cursor_line + 1 + CURSOR_MARGIN_LINES) * HEIGHT + lines - 1) / lines;
+    if (*y_start < 0) *y_start = 0;
+    if (*y_end > HEIGHT) *y_end = HEIGHT;
+    return 1;
+}
+
+// Decide which rows are refreshed this frame: all of them when idle, otherwise
+// the cursor area plus one round-robin slice of the rest of the screen
+void schedule_rows(void) {
+    static long slice = 0;
+    int cursor_start, cursor_end;
+    
+    if (!input_recently_active() || !read_cursor_rows(&cursor_start, &cursor_end)) {
+        memset(row_due, 1, HEIGHT);
+        return;
+    }
+    
+    int current_slice = slice++ % BACKGROUND_SLICES;
+    for (int y = 0; y < HEIGHT; y++) {
+        row_due[y] = (y >= cursor_start && y < cursor_end) ||
+                     (y * BACKGROUND_SLICES / HEIGHT) == current_slice;
+    }
+}
+#endif
+
+// Check if damage fits in one character cell of the console, like the cursor does
+int damage_fits_cell(const damage_t *damage) {
+    #if CURSOR_BLINK_ENABLED
+    int cell_width = CURSOR_CELL_WIDTH, cell_height = CURSOR_CELL_HEIGHT;
+    uint8_t header[4];
+    
+    if (damage->changed_pixels == 0) return 0;
+    
+    // /dev/vcsa header: lines, columns - a scaled cell can straddle one more pixel
+    if (vcsa_fd >= 0 && pread(vcsa_fd, header, sizeof(header), 0) == sizeof(header) && header[0] && header[1]) {
+        cell_width = (WIDTH + header[1] - 1) / header[1] + 1;
+        cell_height = (HEIGHT + header[0] - 1) / header[0] + 1;
+    }
+    
+    return damage->max_x - damage->min_x < cell_width && damage->max_y - damage->min_y < cell_height;
+    #else
+    return 0;
+    #endif
+}
+
+#if CURSOR_BLINK_ENABLED
+// Follow the damage of each sent frame (before prev_frame is updated) to learn
+// a cell that regularly toggles between the same two images
+void track_blink(const uint16_t *current_frame, int full_update) {
+    // Frames without changes don't break the pattern
+    if (!full_update && frame_damage.changed_pixels == 0) return;
+    
+    int width = frame_damage.max_x - frame_damage.min_x + 1;
+    int height = frame_damage.max_y - frame_damage.min_y + 1;
+    if (full_update || !damage_fits_cell(&frame_damage) || width * height > BLINK_MAX_PIXELS) {
+        blink.toggles = 0;
+        return;
+    }
+    
+    uint16_t region[BLINK_MAX_PIXELS];
+    for (int y = 0; y < height; y++) {
+        memcpy(&region[y * width], &current_frame[(frame_damage.min_y + y) * WIDTH + frame_damage.min_x],
+               width * sizeof(uint16_t));
+    }
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    int same_cell = blink.toggles > 0 &&
+                    blink.min_x == frame_damage.min_x && blink.max_x == frame_damage.max_x &&
+                    blink.min_y == frame_damage.min_y && blink.max_y == frame_damage.max_y;
+    
+    if (same_cell && memcmp(region, blink.phase[!blink.shown], width * height * sizeof(uint16_t)) == 0) {
+        // Back to the other image - regular if it took about as long as the previous toggles
+        long elapsed_ms = elapsed_ns_since(&blink.last_toggle) / 1000000;
+        if (blink.toggles == 1 || labs(elapsed_ms - blink.period_ms) <= BLINK_JITTER_MS) {
+            blink.period_ms = blink.toggles == 1 ? elapsed_ms : (blink.period_ms + elapsed_ms) / 2;
+            blink.toggles++;
+        } else {
+            blink.period_ms = elapsed_ms;
+            blink.toggles = 2;
+        }
+        blink.shown = !blink.shown;
+    } else {
+        // New candidate: the cell as it was before this frame and as it is now
+        blink.min_x = frame_damage.min_x;
+        blink.max_x = frame_damage.max_x;
+        blink.min_y = frame_damage.min_y;
+        blink.max_y = frame_damage.max_y;
+        for (int y = 0; y < height; y++) {
+            memcpy(&blink.phase[0][y * width], &prev_frame[(blink.min_y + y) * WIDTH + blink.min_x],
+                   width * sizeof(uint16_t));
+        }
+        memcpy(blink.phase[1], region, width * height * sizeof(uint16_t));
+        blink.shown = 1;
+        blink.toggles = 1;
+        blink.period_ms = 0;
+    }
+    blink.last_toggle = now;
+    
+    // Only the console cursor is replayed, any other toggle (a GUI caret, a
+    // clock) keeps being captured so changes around it are not missed
+    if (blink.toggles >= BLINK_LOCK_TOGGLES && blink_at_cursor()) {
+        blink.locked = 1;
+    }
+}
+
+// Check if the blink box overlaps the character cell of the console cursor,
+// 0 when /dev/vcsa can't be read
+int blink_at_cursor(void) {
+    // /dev/vcsa header: lines, columns, cursor x, cursor y
+    uint8_t header[4];
+    if (vcsa_fd < 0 || pread(vcsa_fd, header, sizeof(header), 0) != sizeof(header) ||
+        header[0] == 0 || header[1] == 0) {
+        return 0;
+    }
+    
+    int cell_x0 = header[2] * WIDTH / header[1];
+    int cell_x1 = ((header[2] + 1) * WIDTH + header[1] - 1) / header[1];
+    int cell_y0 = header[3] * HEIGHT / header[0];
+    int cell_y1 = ((header[3] + 1) * HEIGHT + header[0] - 1) / header[0];
+    
+    return blink.min_x < cell_x1 && blink.max_x >= cell_x0 &&
+           blink.min_y < cell_y1 && blink.max_y >= cell_y0;
+}
+
+// Replay the learned blink without capturing, until a key is pressed, the
+// console text or cursor position changes, or BLINK_VERIFY_MS passed
+void replay_blink(uint16_t *current_frame) {
+    int width = blink.max_x - blink.min_x + 1;
+    int height = blink.max_y - blink.min_y + 1;
+    struct timespec lock_time, input_at_lock = last_input_time;
+    clock_gettime(CLOCK_MONOTONIC, &lock_time);
+    
+    // Console contents when the replay started (the cursor blink itself is not in /dev/vcsa)
+    uint8_t header[4], *console = NULL, *console_now = NULL;
+    size_t console_size = 0;
+    if (vcsa_fd >= 0 && pread(vcsa_fd, header, sizeof(header), 0) == sizeof(header)) {
+        console_size = sizeof(header) + header[0] * header[1] * 2;
+        console = malloc(console_size);
+        console_now = malloc(console_size);
+        if (!console || !console_now || pread(vcsa_fd, console, console_size, 0) != (ssize_t)console_size) {
+            free(console);
+            free(console_now);
+            console = NULL;
+        }
+    }
+    
+    // Without the console contents nothing would end the replay but a key press
+    if (!console) {
+        blink.locked = 0;
+        blink.toggles = 0;
+        return;
+    }
+    
+    set_capture_paused(1);
+    printf("Cursor blink: replaying every %ld ms\n", blink.period_ms);
+    
+    while (keep_running) {
+        input_recently_active();
+        if (last_input_time.tv_sec != input_at_lock.tv_sec || last_input_time.tv_nsec != input_at_lock.tv_nsec) {
+            break;
+        }
+        
+        if (pread(vcsa_fd, console_now, console_size, 0) != (ssize_t)console_size ||
+            memcmp(console, console_now, console_size) != 0) {
+            break;
+        }
+        
+        if (elapsed_ns_since(&lock_time) / 1000000 >= BLINK_VERIFY_MS) {
+            break;
+        }
+        
+        long elapsed_ms = elapsed_ns_since(&blink.last_toggle) / 1000000;
+        if (elapsed_ms >= blink.period_ms) {
+            blink.shown = !blink.shown;
+            send_rect(blink.min_x, blink.min_y, blink.max_x, blink.max_y, blink.phase[blink.shown]);
+            if (end_frame() != 0) {
+                break;
+            }
+            
+            // Keep the previous frame an exact copy of the panel
+            for (int y = 0; y < height; y++) {
+                int idx = (blink.min_y + y) * WIDTH + blink.min_x;
+                memcpy(&prev_frame[idx], &blink.phase[blink.shown][y * width], width * sizeof(uint16_t));
+                memcpy(&current_frame[idx], &blink.phase[blink.shown][y * width], width * sizeof(uint16_t));
+            }
+            
+            // Advance from the planned toggle time so the replay doesn't drift
+            if (elapsed_ms >= blink.period_ms * 2) {
+                clock_gettime(CLOCK_MONOTONIC, &blink.last_toggle);
+            } else {
+                blink.last_toggle.tv_nsec += blink.period_ms * 1000000;
+                while (blink.last_toggle.tv_nsec >= 1000000000) {
+                    blink.last_toggle.tv_nsec -= 1000000000;
+                    blink.last_toggle.tv_sec++;
+                }
+            }
+        }
+        
+        usleep(BLINK_POLL_MS * 1000);
+    }
+    
+    free(console);
+    free(console_now);
+    
+    // Capture again - two more regular toggles lock the blink again
+    blink.locked = 0;
+    blink.toggles = BLINK_LOCK_TOGGLES - 2;
+    set_capture_paused(0);
+    printf("Cursor blink: capturing\n");
+}
+#endif
+
+// Pause or resume the capture thread
+void set_capture_paused(int paused) {
+    #if LATEST_FRAME_WINS
+    pthread_mutex_lock(&capture_lock);
+    capture_paused = paused;
+    pthread_cond_broadcast(&capture_cond);
+    pthread_mutex_unlock(&capture_lock);
+    #endif
+}
+
+#if NET_SINK_ENABLED
+// Connect to every panel server given on the command line (or NET_SINK_HOSTS)
+int init_net_sinks(int argc, char *argv[]) {
+    net_buffer = malloc(PANEL_HEADER_SIZE + PANEL_RLE_MAX_BYTES(DISPLAY_SIZE));
+    if (!net_buffer) {
+        printf("Failed to allocate network buffer\n");
+        return 0;
+    }
+    
+    if (argc > 1) {
+        for (int i = 1; i < argc && num_net_sinks < MAX_NET_SINKS; i++) {
+            net_connect(argv[i]);
+        }
+    } else {
+        char hosts[] = NET_SINK_HOSTS;
+        for (char *host = strtok(hosts, ","); host && num_net_sinks < MAX_NET_SINKS; host = strtok(NULL, ",")) {
+            net_connect(host);
+        }
+    }
+    
+    printf("Network sink: %d panel server(s), max %d frames in flight\n", num_net_sinks, NET_MAX_INFLIGHT);
+    return num_net_sinks > 0;
+}
+
+// Open a TCP connection to a panel server, returns 1 on success
+int net_connect(const char *host) {
+    struct addrinfo hints = { 0 }, *result;
+    char port[8];
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%d", NET_SINK_PORT);
+    
+    if (getaddrinfo(host, port, &hints, &result) != 0) {
+        printf("Failed to resolve panel server %s\n", host);
+        return 0;
+    }
+    
+    int fd = -1;
+    for (struct addrinfo *ai = result; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    
+    if (fd < 0) {
+        printf("Failed to connect to panel server %s:%d\n", host, NET_SINK_PORT);
+        return 0;
+    }
+    
+    // Rectangles are already batched per frame, don't let Nagle hold them back
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    
+    net_sinks[num_net_sinks].fd = fd;
+    net_sinks[num_net_sinks].inflight = 0;
+    num_net_sinks++;
+    printf("Connected to panel server %s:%d\n", host, NET_SINK_PORT);
+    return 1;
+}
+
+// Write all of data to a socket, returns 0 on success
+int net_send_all(int fd, const uint8_t *data, uint32_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR && keep_running) continue;
+        if (sent <= 0) return -1;
+        data += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+// Close a panel server connection that failed
+void net_drop_sink(int index) {
+    printf("Lost connection to panel server %d\n", index);
+    close(net_sinks[index].fd);
+    net_sinks[index] = net_sinks[--num_net_sinks];
+}
+
+// Close all panel server connections
+void close_net_sinks(void) {
+    for (int i = 0; i < num_net_sinks; i++) {
+        close(net_sinks[i].fd);
+    }
+    num_net_sinks = 0;
+    free(net_buffer);
+    net_buffer = NULL;
+}
+#endif
+
+// Pick whether the frame just taken is diffed with the tolerance - every
+// TOLERANCE_REFRESH_EVERY frames the captures read every row until one of them
+// can be diffed exactly, rows left unread would keep their residual error
+void update_tolerance(void) {
+    #if DIFF_TOLERANCE_ENABLED
+    static long tolerance_frames = 0;
+    if (++tolerance_frames % TOLERANCE_REFRESH_EVERY == 0) {
+        full_read_due = 1;
+    }
+    tolerance_active = !full_read_due || memchr(row_fresh, 0, HEIGHT) != NULL;
+    if (!tolerance_active) {
+        full_read_due = 0;
+    }
+    #endif
+}
+
+// Detect changed regions between frames (converts the raw frame in place)
+int detect_changed_regions(uint16_t *current_frame) {
+    if (num_bands == 1) {
+        process_band(current_frame, 0, HEIGHT, &band_workers[0].damage);
+    } else {
+        band_job_frame = current_frame;
+        for (int i = 1; i < num_bands; i++) {
+            sem_post(&band_workers[i].start);
+        }
+        process_band(current_frame, band_workers[0].y_start, band_workers[0].y_end,
+                     &band_workers[0].damage);
+        for (int i = 1; i < num_bands; i++) {
+            sem_wait(&band_done);
+        }
+    }
+    
+    // Merge band summaries
+    frame_damage = band_workers[0].damage;
+    #if CAPTURE_BACKEND_DRM
+    if (frame_from_clips) {
+        frame_damage = frame_clip_damage;
+    }
+    #endif
+    for (int i = 1; i < num_bands; i++) {
+        damage_t *band = &band_workers[i].damage;
+        frame_damage.changed_pixels += band->changed_pixels;
+        if (band->min_x < frame_damage.min_x) frame_damage.min_x = band->min_x;
+        if (band->max_x > frame_damage.max_x) frame_damage.max_x = band->max_x;
+        if (band->min_y < frame_damage.min_y) frame_damage.min_y = band->min_y;
+        if (band->max_y > frame_damage.max_y) frame_damage.max_y = band->max_y;
+    }
+    
+    // Calculate change percentage
+    float change_percent = (frame_damage.changed_pixels * 100.0f) / DISPLAY_SIZE;
+    
+    // If too many changes, just update the whole screen
+    if (change_percent > CHANGE_THRESHOLD) {
+        return 1; // Full update
+    }
+    
+    return 0; // Partial update
+}
+
+// Update only the changed regions with interlacing support
+void update_changed_regions(uint16_t *current_frame) {
+    // For simplicity, we'll update the bounding box of changed areas
+    // merged from the band damage summaries
+    
+    int min_x = frame_damage.min_x, max_x = frame_damage.max_x;
+    int min_y = frame_damage.min_y, max_y = frame_damage.max_y;
+    int changed_areas = frame_damage.changed_pixels;
+    
+    // If we found a reasonable changed area (or just the cursor cell), update it
+    if ((changed_areas > MIN_UPDATE_REGION && 
+         (max_x - min_x) > 2 && (max_y - min_y) > 2) || damage_fits_cell(&frame_damage)) {
+        
+        // Extract and send only the changed region
+        int region_width = max_x - min_x + 1;
+        int region_height = max_y - min_y + 1;
+        int region_size = region_width * region_height;
+        
+        uint16_t *region_buffer = malloc(region_size * 2);
+        if (!region_buffer) {
+            // Fallback to full update if memory allocation fails
+            send_rect(0, 0, WIDTH-1, HEIGHT-1, current_frame);
+            return;
+        }
+        
+        // Copy changed region
+        for (int y = min_y; y <= max_y; y++) {
+            for (int x = min_x; x <= max_x; x++) {
+                int src_idx = y * WIDTH + x;
+                int dst_idx = (y - min_y) * region_width + (x - min_x);
+                region_buffer[dst_idx] = current_frame[src_idx];
+            }
+        }
+        
+        // Send region data
+        send_rect(min_x, min_y, max_x, max_y, region_buffer);
+        free(region_buffer);
+        
+        printf("Partial update: Region %d,%d to %d,%d (%d pixels)\n", 
+               min_x, min_y, max_x, max_y, region_size);
+    } else if (changed_areas > 0) {
+        // Small changes, do full update for simplicity
+        send_rect(0, 0, WIDTH-1, HEIGHT-1, current_frame);
+    }
+    // Else: no changes, no update needed
+}
+
+// Update interlaced regions - optimized for speed
+void update_interlaced_regions(uint16_t *current_frame) {
+    #if INTERLACE_ENABLED
+    // For interlaced mode, black lines never differ from the previous
+    // frame, so the merged band damage only covers non-black lines
+    int min_x = frame_damage.min_x, max_x = frame_damage.max_x;
+    int min_y = frame_damage.min_y, max_y = frame_damage.max_y;
+    int changed_areas = frame_damage.changed_pixels;
+    
+    // If we found a reasonable changed area (or just the cursor cell), update it
+    if ((changed_areas > MIN_UPDATE_REGION && 
+         (max_x - min_x) > 2 && (max_y - min_y) > 2) || damage_fits_cell(&frame_damage)) {
         
         // Extract and send only the changed region
         int region_width = max_x - min_x + 1;
@@ -403,8 +1696,7 @@ void update_interlaced_regions(uint16_t *current_frame, uint16_t *update_mask) {
         uint16_t *region_buffer = malloc(region_size * 2);
         if (!region_buffer) {
             // Fallback to full update if memory allocation fails
-            set_window(0, 0, WIDTH-1, HEIGHT-1);
-            write_data_len((uint8_t*)current_frame, DISPLAY_BYTES);
+            send_rect(0, 0, WIDTH-1, HEIGHT-1, current_frame);
             return;
         }
         
@@ -418,22 +1710,289 @@ void update_interlaced_regions(uint16_t *current_frame, uint16_t *update_mask) {
         }
         
         // Send region data
-        write_data_len((uint8_t*)region_buffer, region_size * 2);
+        send_rect(min_x, min_y, max_x, max_y, region_buffer);
         free(region_buffer);
         
         printf("Interlaced partial update: Region %d,%d to %d,%d (%d pixels)\n", 
                min_x, min_y, max_x, max_y, region_size);
     } else if (changed_areas > 0) {
         // Small changes, do full update for simplicity
-        set_window(0, 0, WIDTH-1, HEIGHT-1);
-        write_data_len((uint8_t*)current_frame, DISPLAY_BYTES);
+        send_rect(0, 0, WIDTH-1, HEIGHT-1, current_frame);
     }
     // Else: no changes, no update needed
     #else
-    update_changed_regions(current_frame, update_mask);
+    update_changed_regions(current_frame);
     #endif
 }
 
+#if MULTIRATE_ENABLED
+// Send every run of rows read this frame as its own rectangle - the whole width
+// on a full update, otherwise the changed box of the run. While typing this keeps
+// the cursor line and the background slice apart instead of sending the box
+// around both, or the whole screen
+void update_fresh_runs(uint16_t *current_frame, int full_update) {
+    int y = 0;
+    
+    while (y < HEIGHT) {
+        if (!row_fresh[y]) {
+            y++;
+            continue;
+        }
+        
+        int run_start = y;
+        while (y < HEIGHT && row_fresh[y]) y++;
+        
+        if (full_update) {
+            send_rect(0, run_start, WIDTH-1, y - 1, &current_frame[run_start * WIDTH]);
+            continue;
+        }
+        
+        // Changed box of the run
+        int min_x = WIDTH, max_x = -1, min_y = HEIGHT, max_y = -1;
+        for (int row = run_start; row < y; row++) {
+            if (row_max_x[row] < 0) continue;
+            if (row_min_x[row] < min_x) min_x = row_min_x[row];
+            if (row_max_x[row] > max_x) max_x = row_max_x[row];
+            if (row < min_y) min_y = row;
+            max_y = row;
+        }
+        if (max_x < 0) continue;
+        
+        int region_width = max_x - min_x + 1;
+        uint16_t *region_buffer = malloc(region_width * (max_y - min_y + 1) * 2);
+        if (!region_buffer) {
+            // Fallback to the whole run if memory allocation fails
+            send_rect(0, run_start, WIDTH-1, y - 1, &current_frame[run_start * WIDTH]);
+            continue;
+        }
+        
+        for (int row = min_y; row <= max_y; row++) {
+            memcpy(&region_buffer[(row - min_y) * region_width], &current_frame[row * WIDTH + min_x],
+                   region_width * sizeof(uint16_t));
+        }
+        send_rect(min_x, min_y, max_x, max_y, region_buffer);
+        free(region_buffer);
+    }
+}
+#endif
+
+// Nanoseconds elapsed since start
+long elapsed_ns_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000000 + (now.tv_nsec - start->tv_nsec);
+}
+
+#if ROW_HASH_ENABLED
+// 64-bit hash of one row segment - FNV-1a over 64-bit words, folded after each
+// multiply so changes in the high bits also reach the low ones
+uint64_t hash_segment(const uint16_t *pixels) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (int x = 0; x < SEGMENT_WIDTH; x += 4) {
+        uint64_t word;
+        memcpy(&word, &pixels[x], sizeof(word));
+        h = (h ^ word) * 0x100000001B3ULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+// Read the wanted rows band by band, hash them and send the runs of rows whose
+// hashes changed (every wanted row when verifying). snapshot is the full height
+// image the rows are read into when the snapshot is not mapped. Returns 0 on success
+int update_hashed_rows(uint16_t *snapshot, uint16_t *band, uint16_t *region, const uint8_t *row_wanted, int verify) {
+    for (int y = 0; y < HEIGHT; y++) {
+        if (!row_wanted[y]) continue;
+        
+        int y_end = y + 1;
+        while (y_end < HEIGHT && row_wanted[y_end] && y_end - y < ROW_HASH_BAND_ROWS) y_end++;
+        
+        // Hash straight from the snapshot when it is mapped, only changed rows are copied
+        const uint16_t *src;
+        if (mapped_frame) {
+            src = &mapped_frame[y * WIDTH];
+        } else if (read_band(snapshot, y, y_end) != 0) {
+            printf("Failed to read resource data\n");
+            return -1;
+        } else {
+            src = &snapshot[y * WIDTH];
+        }
+        
+        struct timespec detect_start;
+        clock_gettime(CLOCK_MONOTONIC, &detect_start);
+        
+        // Changed segment range of each row, first > last when unchanged
+        int first_segment[ROW_HASH_BAND_ROWS], last_segment[ROW_HASH_BAND_ROWS];
+        for (int row = y; row < y_end; row++) {
+            const uint16_t *row_src = &src[(row - y) * WIDTH];
+            uint16_t *pixels = &band[(row - y) * WIDTH];
+            first_segment[row - y] = ROW_HASH_SEGMENTS;
+            last_segment[row - y] = -1;
+            
+            #if INTERLACE_ENABLED
+            // Black lines never change on the panel
+            if (row % INTERLACE_EVERY == 1) {
+                memset(pixels, 0, WIDTH * sizeof(uint16_t));
+                if (verify) {
+                    first_segment[row - y] = 0;
+                    last_segment[row - y] = ROW_HASH_SEGMENTS - 1;
+                }
+                continue;
+            }
+            #endif
+            
+            for (int seg = 0; seg < ROW_HASH_SEGMENTS; seg++) {
+                uint64_t h = hash_segment(&row_src[seg * SEGMENT_WIDTH]);
+                if (h == row_hashes[row][seg] && !verify) continue;
+                
+                row_hashes[row][seg] = h;
+                if (seg < first_segment[row - y]) first_segment[row - y] = seg;
+                last_segment[row - y] = seg;
+            }
+            
+            // Apply color correction to changed rows only
+            if (last_segment[row - y] >= 0) {
+                for (int x = 0; x < WIDTH; x++) {
+                    pixels[x] = fix_color_format(row_src[x]);
+                }
+            }
+        }
+        
+        detect_ns += elapsed_ns_since(&detect_start);
+        
+        // Send each run of changed rows, as wide as its changed segments
+        for (int row = y; row < y_end; row++) {
+            if (last_segment[row - y] < 0) continue;
+            
+            int run_end = row + 1;
+            int seg_start = first_segment[row - y], seg_end = last_segment[row - y];
+            while (run_end < y_end && last_segment[run_end - y] >= 0) {
+                if (first_segment[run_end - y] < seg_start) seg_start = first_segment[run_end - y];
+                if (last_segment[run_end - y] > seg_end) seg_end = last_segment[run_end - y];
+                run_end++;
+            }
+            
+            int x_start = seg_start * SEGMENT_WIDTH;
+            int region_width = (seg_end + 1 - seg_start) * SEGMENT_WIDTH;
+            if (region_width == WIDTH) {
+                send_rect(0, row, WIDTH-1, run_end-1, &band[(row - y) * WIDTH]);
+            } else {
+                // Pack the changed columns of the run
+                for (int r = row; r < run_end; r++) {
+                    memcpy(&region[(r - row) * region_width], &band[(r - y) * WIDTH + x_start],
+                           region_width * sizeof(uint16_t));
+                }
+                send_rect(x_start, row, x_start + region_width - 1, run_end-1, region);
+            }
+            
+            row = run_end;
+        }
+        
+        y = y_end - 1;
+    }
+    
+    return 0;
+}
+
+// Display loop for the row hash mode - no previous frame, only the hashes
+void display_framebuffer_row_hash(void) {
+    printf("Row hash display with partial updates (%d segments per row)...\n", ROW_HASH_SEGMENTS);
+    
+    struct timespec start_time, current_time;
+    long frame_count = 0;
+    long total_frames = 0;
+    long hash_frames = 0;
+    int verify_due = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    
+    // One band of rows and the packed columns of a run, plus a full height image
+    // for the reads when the snapshot is not mapped (dispmanx writes each row at
+    // its own offset, so a band sized buffer is not enough)
+    uint16_t *band = malloc(ROW_HASH_BAND_ROWS * WIDTH * sizeof(uint16_t));
+    uint16_t *region = malloc(ROW_HASH_BAND_ROWS * WIDTH * sizeof(uint16_t));
+    uint16_t *snapshot = mapped_frame ? NULL : malloc(DISPLAY_SIZE * sizeof(uint16_t));
+    
+    if (!band || !region || (!mapped_frame && !snapshot)) {
+        printf("Failed to allocate buffers\n");
+        free(band);
+        free(region);
+        free(snapshot);
+        return;
+    }
+    
+    while (keep_running) {
+        #if MULTIRATE_ENABLED
+        // Pick the rows refreshed this frame
+        schedule_rows();
+        #endif
+        
+        uint8_t row_wanted[HEIGHT];
+        int planned = plan_capture(row_wanted, 0);
+        if (planned < 0) {
+            break;
+        }
+        
+        // The collision guard waits for a frame that reads every row
+        if (hash_frames++ % ROW_HASH_VERIFY_EVERY == 0) {
+            verify_due = 1;
+        }
+        
+        if (planned > 0) {
+            int verify = verify_due && memchr(row_wanted, 0, HEIGHT) == NULL;
+            if (verify) verify_due = 0;
+            
+            int result = update_hashed_rows(snapshot, band, region, row_wanted, verify);
+            
+            #if CAPTURE_BACKEND_DRM
+            drm_capture_end();
+            #endif
+            
+            if (result != 0) {
+                break;
+            }
+        }
+        
+        // Frame boundary for the network sink (waits for a slow panel server)
+        if (end_frame() != 0) {
+            break;
+        }
+        
+        report_time_to_first_frame();
+        
+        frame_count++;
+        total_frames++;
+        
+        // FPS reporting every 30 frames
+        if (frame_count % 30 == 0) {
+            clock_gettime(CLOCK_MONOTONIC, &current_time);
+            long elapsed_time = (current_time.tv_sec - start_time.tv_sec) * 1000000000 + 
+                               (current_time.tv_nsec - start_time.tv_nsec);
+            
+            if (elapsed_time >= 500000000) {  // Report every 0.5 seconds for better responsiveness
+                float fps = frame_count * 1000000000.0f / elapsed_time;
+                #if NET_SINK_ENABLED
+                printf("FPS: %.1f (Total: %ld, Detect: %.3f ms, Sent: %ld KB)\n", fps, total_frames,
+                       detect_ns / 1000000.0f / frame_count, net_bytes_sent / 1024);
+                #else
+                printf("FPS: %.1f (Total: %ld, Detect: %.3f ms)\n", fps, total_frames,
+                       detect_ns / 1000000.0f / frame_count);
+                #endif
+                frame_count = 0;
+                detect_ns = 0;
+                clock_gettime(CLOCK_MONOTONIC, &start_time);
+            }
+        }
+        
+        // Small sleep to prevent 100% CPU usage
+        usleep(2000);
+    }
+    
+    free(band);
+    free(region);
+    free(snapshot);
+}
+#endif
+
 // Smart display function with partial updates and interlacing
 void display_framebuffer_smart_update(void) {
     printf("Smart display with partial updates");
@@ -449,52 +2008,111 @@ void display_framebuffer_smart_update(void) {
     
     // Allocate buffers
     uint16_t *current_frame = malloc(DISPLAY_BYTES);
-    uint16_t *update_mask = malloc(DISPLAY_SIZE * sizeof(uint16_t));
     
-    if (!current_frame || !update_mask) {
+    if (!current_frame) {
         printf("Failed to allocate buffers\n");
+        return;
+    }
+    
+    #if LATEST_FRAME_WINS
+    // Start capturing in the background
+    capture_buffer = malloc(DISPLAY_BYTES);
+    capture_running = capture_buffer &&
+                      pthread_create(&capture_thread, NULL, capture_thread_main, NULL) == 0;
+    if (!capture_running) {
+        printf("Failed to start capture thread\n");
+        free(capture_buffer);
         free(current_frame);
-        free(update_mask);
         return;
     }
+    #endif
     
     while (keep_running) {
-        // GPU-accelerated snapshot
-        if (vc_dispmanx_snapshot(display_handle, resource_handle, 0) != 0) {
-            printf("Dispmanx snapshot failed\n");
-            break;
+        #if CURSOR_BLINK_ENABLED
+        // A learned cursor blink is replayed instead of captured
+        if (blink.locked) {
+            replay_blink(current_frame);
         }
+        #endif
         
-        // Read data from GPU resource
-        if (vc_dispmanx_resource_read_data(resource_handle, &rect, current_frame, WIDTH * 2) != 0) {
-            printf("Failed to read resource data\n");
+        #if LATEST_FRAME_WINS
+        // Newest capture, merged with the ones there was no time to send
+        if (take_latest_capture(current_frame) != 0) {
             break;
         }
+        #else
+        #if MULTIRATE_ENABLED
+        // Pick the rows refreshed this frame
+        schedule_rows();
+        #endif
         
-        // Apply color correction
-        for (int i = 0; i < DISPLAY_SIZE; i++) {
-            current_frame[i] = fix_color_format(current_frame[i]);
+        // Capture the screen (only changed/scheduled bands)
+        if (capture_frame(current_frame, row_fresh, full_read_due) != 0) {
+            break;
         }
+        update_tolerance();
         
-        // Apply interlacing if enabled
-        apply_interlacing(current_frame);
+        #if CAPTURE_BACKEND_DRM
+        frame_from_clips = damage_from_clips;
+        frame_clip_damage = clip_damage;
+        #endif
+        #endif
         
-        // Detect changed regions
-        int full_update = detect_changed_regions(current_frame, update_mask);
+        // Convert, apply interlacing and detect changed regions (band-parallel)
+        struct timespec detect_start;
+        clock_gettime(CLOCK_MONOTONIC, &detect_start);
+        int full_update = detect_changed_regions(current_frame);
+        detect_ns += elapsed_ns_since(&detect_start);
         
-        if (full_update) {
+        #if LATEST_FRAME_WINS
+        release_capture();
+        #endif
+        
+        #if GOVERNOR_ENABLED
+        // Back from 12-bit, every pixel on the panel lost precision - resend the
+        // whole frame, rows not read this frame still hold what the panel shows
+        if (governor_update(frame_damage.changed_pixels)) {
+            full_update = 1;
+            #if MULTIRATE_ENABLED
+            memset(row_fresh, 1, HEIGHT);
+            #endif
+        }
+        #endif
+        
+        // Only some rows were read (multi-rate refresh while typing, or the probe)
+        int rows_limited = 0;
+        #if MULTIRATE_ENABLED
+        rows_limited = memchr(row_fresh, 0, HEIGHT) != NULL;
+        #endif
+        
+        if (rows_limited) {
+            #if MULTIRATE_ENABLED
+            // Rows not read are unchanged, send the runs that were read one by one
+            update_fresh_runs(current_frame, full_update);
+            #endif
+        } else if (full_update) {
             // Full screen update
-            set_window(0, 0, WIDTH-1, HEIGHT-1);
-            write_data_len((uint8_t*)current_frame, DISPLAY_BYTES);
+            send_rect(0, 0, WIDTH-1, HEIGHT-1, current_frame);
             printf("Full update\n");
         } else {
             // Partial update of changed regions
-            update_interlaced_regions(current_frame, update_mask);
+            update_interlaced_regions(current_frame);
+        }
+        
+        #if CURSOR_BLINK_ENABLED
+        track_blink(current_frame, full_update);
+        #endif
+        
+        // Frame boundary for the network sink (waits for a slow panel server)
+        if (end_frame() != 0) {
+            break;
         }
         
         // Update previous frame
         memcpy(prev_frame, current_frame, DISPLAY_BYTES);
         
+        report_time_to_first_frame();
+        
         frame_count++;
         total_frames++;
         
@@ -506,57 +2124,133 @@ void display_framebuffer_smart_update(void) {
             
             if (elapsed_time >= 500000000) {  // Report every 0.5 seconds for better responsiveness
                 float fps = frame_count * 1000000000.0f / elapsed_time;
-                printf("FPS: %.1f (Total: %ld)\n", fps, total_frames);
+                printf("FPS: %.1f", fps);
+                #if GOVERNOR_ENABLED
+                printf(" [%d-bit]", color_degraded ? 12 : 16);
+                #endif
+                printf(" (Total: %ld, Detect: %.3f ms", total_frames, detect_ns / 1000000.0f / frame_count);
+                #if LATEST_FRAME_WINS
+                pthread_mutex_lock(&capture_lock);
+                printf(", Superseded: %ld", superseded_frames);
+                pthread_mutex_unlock(&capture_lock);
+                #endif
+                #if NET_SINK_ENABLED
+                printf(", Sent: %ld KB", net_bytes_sent / 1024);
+                #endif
+                printf(")\n");
                 frame_count = 0;
+                detect_ns = 0;
                 clock_gettime(CLOCK_MONOTONIC, &start_time);
             }
         }
         
+        #if !LATEST_FRAME_WINS
         // Small sleep to prevent 100% CPU usage
         usleep(2000);  // Reduced sleep for higher FPS
+        #endif
     }
     
+    #if LATEST_FRAME_WINS
+    pthread_mutex_lock(&capture_lock);
+    capture_exit = 1;
+    pthread_cond_broadcast(&capture_cond);
+    pthread_mutex_unlock(&capture_lock);
+    pthread_join(capture_thread, NULL);
+    free(capture_buffer);
+    #endif
+    
     free(current_frame);
-    free(update_mask);
+}
+
+// Report time from startup to the first frame sent (once)
+void report_time_to_first_frame(void) {
+    static int reported = 0;
+    if (reported) return;
+    reported = 1;
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed_ns = (now.tv_sec - startup_time.tv_sec) * 1000000000 +
+                      (now.tv_nsec - startup_time.tv_nsec);
+    printf("Time to first frame: %.1f ms\n", elapsed_ns / 1000000.0f);
 }
 
 // Cleanup resources
 void cleanup(void) {
     printf("Cleaning up resources...\n");
     
+    stop_workers();
+    
+    #if CONSOLE_INPUT_ENABLED
+    if (vcsa_fd >= 0) {
+        close(vcsa_fd);
+    }
+    for (int i = 0; i < num_input_fds; i++) {
+        close(input_fds[i]);
+    }
+    #endif
+    
+    #if CAPTURE_BACKEND_DRM
+    drm_capture_cleanup();
+    #else
     // Clean up GPU resources
+    dispmanx_unmap_resource();
+    
     if (resource_handle != 0) {
         vc_dispmanx_resource_delete(resource_handle);
     }
     
+    #if PROBE_ENABLED
+    if (probe_resource_handle != 0) {
+        vc_dispmanx_resource_delete(probe_resource_handle);
+    }
+    #endif
+    
     if (display_handle != 0) {
         vc_dispmanx_display_close(display_handle);
     }
     
+    bcm_host_deinit();
+    #endif
+    
     // Free previous frame buffer
     if (prev_frame) {
         free(prev_frame);
     }
     
-    bcm_host_deinit();
+    #if NET_SINK_ENABLED
+    close_net_sinks();
+    #else
     bcm2835_spi_end();
     bcm2835_close();
+    #endif
 }
 
 // Main function
 int main(int argc, char *argv[]) {
+    clock_gettime(CLOCK_MONOTONIC, &startup_time);
+    
     printf("Smart Partial Update Display with GPU Acceleration\n");
     printf("Display dimensions: %dx%d\n", WIDTH, HEIGHT);
     
     // Set up signal handler for clean exit
     signal(SIGINT, signal_handler);
     
+    #if NET_SINK_ENABLED
+    // No local panel, the panel servers own the displays
+    if (!init_net_sinks(argc, argv)) {
+        printf("Failed to connect to any panel server\n");
+        cleanup();
+        return 1;
+    }
+    #else
     init_gpio();
     init_spi();
     
     printf("Initializing display...\n");
     init_display();
     printf("Display initialized\n");
+    #endif
     
     printf("Initializing GPU resources...\n");
     if (!init_gpu_resources()) {
@@ -566,10 +2260,26 @@ int main(int argc, char *argv[]) {
     }
     printf("GPU resources initialized\n");
     
+    #if !ROW_HASH_ENABLED
+    init_workers();
+    #endif
+    
+    #if CONSOLE_INPUT_ENABLED
+    init_console_input();
+    #endif
+    
+    #if MULTIRATE_ENABLED
+    init_multirate();
+    #endif
+    
     printf("Starting smart display with partial updates...\n");
     printf("Press Ctrl+C to exit\n");
     
+    #if ROW_HASH_ENABLED
+    display_framebuffer_row_hash();
+    #else
     display_framebuffer_smart_update();
+    #endif
     
     cleanup();
     printf("Exited cleanly\n");